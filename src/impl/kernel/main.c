@@ -11,15 +11,19 @@
 #include "drivers/ata.h"
 #include "sys/editor.h"
 #include "sys/shell.h"
+#include "core/irq.h"
+#include "drivers/pic.h"
+#include "drivers/rtl8139.h"
+#include "drivers/acpi.h"
+#include "drivers/apic.h"
 
-extern void irq0_stub();
-extern void irq1_stub();
-void pic_remap();
+extern void page_fault_stub();
 
-extern void memory_init(uint64_t mem_upper);
-extern void irq_nic_stub();
+// Linker script symbols bracketing the loaded image
+extern uint8_t _kernel_start[];
+extern uint8_t _kernel_end[];
 
-void kernel_main() {
+void kernel_main(uint64_t multiboot_info) {
     print_set_theme(THEME_CYBERPUNK);
     print_clear();
 
@@ -31,27 +35,41 @@ void kernel_main() {
     idt_init();
     pic_remap();
 
-    // Set keyboard IRQ (IRQ1) handler
-    idt_set_entry(0x21, irq1_stub, 0x8E);
-    idt_set_entry(0x20, irq0_stub, 0x8E);
+    // Hardware interrupts go through irq_dispatch; drivers register for lines
+    irq_init();
+
+    // Page faults (vector 14): demand paging for vmregion, a report otherwise
+    idt_set_entry(14, page_fault_stub, 0x8E);
 
     // Initialize keyboard and enable interrupts
     init_keyboard();
     timer_init();
-    memory_init(512 * 1024);
 
-    uint64_t kernel_start = 0x100000;
-    uint64_t kernel_end   = 0x120000;
+    // The image runs in the higher half; the allocators want its frames
+    uint64_t kernel_start = virt_to_phys(_kernel_start);
+    uint64_t kernel_end   = virt_to_phys(_kernel_end);
+
+    // The RSDP copy in the multiboot info is gone once memory_init is done
+    int have_acpi = acpi_init(multiboot_info) == 0;
+    memory_init(multiboot_info, kernel_start, kernel_end);
+
     uint64_t heap_start   = 0x200000;
     uint64_t heap_size    = 1024*1024;
 
     paging_init(kernel_start, kernel_end, heap_start, heap_size);
-    heap_init(heap_start, heap_size);
+    heap_init(HEAP_VIRT_BASE, heap_size);
+#ifdef HEAP_PROFILE
+    heap_prof_enable(1);    // Catch boot-time allocations too
+#endif
 
     expand_scrollback();
+
+    // Move the IRQ lines from the 8259 to the I/O APIC when ACPI has a MADT
+    if (!have_acpi || apic_init() != 0) {
+        print_str("Using the 8259 PIC\n");
+    }
     
     if (rtl8139_probe_init() == 0) {
-        idt_set_entry(0x20 + 0xFF, irq_nic_stub, 0x8E);
         print_str("[NET] NIC driver installed\n");
     }
 
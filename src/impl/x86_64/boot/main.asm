@@ -1,10 +1,15 @@
 global start
+global stack_top
+global gdt64
 extern long_mode_start
 
-section .text
+; The kernel is linked in the higher half. This file runs before paging is
+; on, so it lives in low sections loaded and linked at the same address.
+section .boot.text
     bits 32
 start:
     mov esp, stack_top
+    mov edi, ebx                ; multiboot2 info pointer; cpuid below clobbers ebx
 
     call check_multiboot
     call ckeck_cpuid
@@ -27,14 +32,23 @@ check_multiboot:
     mov al, "M"
     jmp error
 
+; The first 1 GB three times over: identity (for the jump to 64-bit code),
+; at the direct map base (PML4 slot 256) and at the kernel's link address
+; (-2 GB: PML4 slot 511, PDPT slot 510). All share one page directory.
 setup_page_tables:
     mov eax, page_table_l3
     or eax, 0b11
     mov [page_table_l4], eax
+    mov [page_table_l4 + 256 * 8], eax
+
+    mov eax, page_table_l3_high
+    or eax, 0b11
+    mov [page_table_l4 + 511 * 8], eax
 
     mov eax, page_table_l2
     or eax, 0b11
     mov [page_table_l3], eax
+    mov [page_table_l3_high + 510 * 8], eax
     
     mov ecx, 0
 
@@ -111,19 +125,21 @@ check_long_mode:
     mov al, "L"
     jmp error
 
-section .bss
+section .boot.bss nobits alloc write
     align 4096
 page_table_l4:
     resb 4096
 page_table_l3:
     resb 4096
+page_table_l3_high:
+    resb 4096
 page_table_l2:
     resb 4096
 stack_bottom:
     resb 4096 * 4
 stack_top:
 
-section .rodata
+section .boot.rodata progbits alloc noexec nowrite
 gdt64:
     dq 0
 .code_segment: equ $ - gdt64
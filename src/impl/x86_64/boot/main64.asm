@@ -1,7 +1,12 @@
 global long_mode_start
 extern kernel_main
+extern stack_top
+extern gdt64
 
-section .text
+KERNEL_VMA equ 0xFFFFFFFF80000000
+
+; Reached by a far jump from 32-bit code, so still at a low address
+section .boot.text
 bits 64
 long_mode_start:
     mov ax, 0
@@ -11,7 +16,23 @@ long_mode_start:
     mov fs, ax
     mov gs, ax
 
+    mov rax, higher_half_start
+    jmp rax
+
+section .text
+higher_half_start:
+    ; Stack and GDT through their higher-half alias; paging_init drops the
+    ; identity map they were reached through so far
+    mov rsp, stack_top + KERNEL_VMA
+    lgdt [gdt64_pointer_high]
+
     ; mov dword [0xb8000], 0x2f4b2f4f
+    mov edi, edi                ; zero-extend the multiboot2 info pointer
     call kernel_main
     
-    hlt
\ No newline at end of file
+    hlt
+
+section .rodata
+gdt64_pointer_high:
+    dw 15                       ; null and code descriptor
+    dq gdt64 + KERNEL_VMA
@@ -1,54 +1,58 @@
-extern isr_keyboard
-
-global irq1_stub
-irq1_stub:
+extern irq_dispatch
+
+%define IRQ_LINES 224      ; must match IRQ_LINES in core/irq.h
+
+; One tiny stub per hardware vector: push the line number and share the
+; rest. Lines are numbered from vector 0x20.
+%assign i 0
+%rep IRQ_LINES
+irq_stub_%+i:
+    push qword i
+    jmp irq_common
+%assign i i+1
+%endrep
+
+; irq_dispatch is plain C, so only the caller-saved registers need saving;
+; it preserves rbx, rbp and r12-r15 itself.
+irq_common:
     push rax
     push rcx
     push rdx
-    push rbx
-    push rsp
-    push rbp
     push rsi
     push rdi
     push r8
     push r9
     push r10
     push r11
-    push r12
-    push r13
-    push r14
-    push r15
 
-    call isr_keyboard
+    mov rdi, [rsp + 9 * 8]      ; line number from the stub
+    cld
 
-    ; send EOI to PIC
-    mov al, 0x20
-    out 0x20, al
+    ; The CPU aligned rsp to 16 before its 5-word frame; the line number
+    ; and 9 registers make 15 words, so one pad realigns it for the call
+    sub rsp, 8
+    call irq_dispatch
+    add rsp, 8
 
-    pop r15
-    pop r14
-    pop r13
-    pop r12
     pop r11
     pop r10
     pop r9
     pop r8
     pop rdi
     pop rsi
-    pop rbp
-    pop rsp
-    pop rbx
     pop rdx
     pop rcx
     pop rax
 
+    add rsp, 8                  ; drop the line number
     iretq
 
-extern isr_timer       ; Your C handler for timer interrupt
+extern isr_page_fault
 
-global irq0_stub
-irq0_stub:
-    ; Save all general-purpose registers
+; Vector 14. The CPU pushes an error code on top of the usual frame; it has
+; to come off again before iretq.
+global page_fault_stub
+page_fault_stub:
     push rax
     push rcx
     push rdx
@@ -66,14 +70,10 @@ irq0_stub:
     push r14
     push r15
 
-    ; Call C handler
-    call isr_timer
-
-    ; Send End-of-Interrupt (EOI) to PIC
-    mov al, 0x20
-    out 0x20, al
+    mov rdi, [rsp + 16 * 8]     ; error code
+    mov rsi, [rsp + 17 * 8]     ; faulting rip
+    call isr_page_fault
 
-    ; Restore all registers
     pop r15
     pop r14
     pop r13
@@ -91,50 +91,16 @@ irq0_stub:
     pop rcx
     pop rax
 
+    add rsp, 8                  ; drop the error code
     iretq
 
-extern rtl8139_handle_irq
+section .rodata
 
-global irq_nic_stub
-irq_nic_stub:
-    push rax
-    push rcx
-    push rdx
-    push rbx
-    push rsp
-    push rbp
-    push rsi
-    push rdi
-    push r8
-    push r9
-    push r10
-    push r11
-    push r12
-    push r13
-    push r14
-    push r15
-
-    call rtl8139_handle_irq
-
-    ; Acknowledge master/slave PIC only if needed: since rtl8139 writes ISR, still need EOI
-    mov al, 0x20
-    out 0x20, al
-
-    pop r15
-    pop r14
-    pop r13
-    pop r12
-    pop r11
-    pop r10
-    pop r9
-    pop r8
-    pop rdi
-    pop rsi
-    pop rbp
-    pop rsp
-    pop rbx
-    pop rdx
-    pop rcx
-    pop rax
-
-    iretq
+; Stub addresses by line, for irq_init
+global irq_stub_table
+irq_stub_table:
+%assign i 0
+%rep IRQ_LINES
+    dq irq_stub_%+i
+%assign i i+1
+%endrep
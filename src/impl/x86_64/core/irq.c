@@ -0,0 +1,254 @@
+#include "core/irq.h"
+#include "core/idt.h"
+#include "drivers/pic.h"
+#include "core/softirq.h"
+#include "drivers/timer.h"
+#include "../lib/cpu.h"
+#include <stddef.h>
+
+extern void* irq_stub_table[IRQ_LINES];   // irq.asm
+
+typedef struct irq_action {
+    irq_handler_t handler;  // 0 = slot unused
+    void* ctx;
+    struct irq_action* next;
+} irq_action_t;
+
+// Drivers register before the heap exists, so actions come from a fixed pool.
+// Chains are walked from interrupt context; edit them with interrupts off.
+static irq_action_t actions[IRQ_ACTIONS_MAX];
+static irq_action_t* lines[IRQ_LINES];
+static const irq_chip_t* chip = &pic_chip;
+static uint8_t allocated[IRQ_LINES];    // Lines irq_alloc_lines gave out
+static uint8_t triggers[IRQ_LINES];     // IRQ_TRIGGER_*, set by the first handler on a line
+
+typedef struct {
+    uint64_t count;
+    uint64_t unhandled;
+    uint64_t spurious;
+    uint64_t samples;
+    uint64_t cycles_min;
+    uint64_t cycles_max;
+    uint64_t cycles_total;
+    uint64_t storms;
+    uint32_t window_start;  // Tick the current one-second window began
+    uint32_t window_count;
+    int storming;
+} irq_line_stats_t;
+
+static irq_line_stats_t stats[IRQ_LINES];
+static int sampling = 0;
+
+// Starts a new window once the current one is a second old. Called on
+// dispatch and when the stats are read, so a line that went silent loses
+// its storm flag too: a whole quiet window clears it.
+static void storm_expire(irq_line_stats_t* s, uint32_t now) {
+    if (now - s->window_start < TIMER_FREQ) return;
+    if (s->window_count <= IRQ_STORM_RATE || now - s->window_start >= 2 * TIMER_FREQ) {
+        s->storming = 0;
+    }
+    s->window_start = now;
+    s->window_count = 0;
+}
+
+
+void irq_init() {
+    for (int i = 0; i < IRQ_LINES; i++) {
+        idt_set_entry(IRQ_BASE_VECTOR + i, irq_stub_table[i], 0x8E);
+    }
+}
+
+void irq_set_chip(const irq_chip_t* next) {
+    uint64_t flags = irq_save();
+    for (uint32_t line = 0; line < IRQ_LINES; line++) {
+        if (!lines[line] || allocated[line]) continue;
+        if (line < chip->lines) chip->mask(line);
+        if (line < next->lines) next->unmask(line, triggers[line]);
+    }
+    chip = next;
+    irq_restore(flags);
+}
+
+const irq_chip_t* irq_get_chip() {
+    return chip;
+}
+
+void irq_set_sampling(int on) {
+    sampling = on;
+}
+
+int irq_get_sampling() {
+    return sampling;
+}
+
+int irq_get_stats(uint32_t line, irq_stats_t* out) {
+    if (line >= IRQ_LINES) return -1;
+
+    irq_line_stats_t* s = &stats[line];
+    uint64_t flags = irq_save();
+    storm_expire(s, get_tick());
+    irq_restore(flags);
+
+    out->handlers = 0;
+    for (irq_action_t* action = lines[line]; action; action = action->next) out->handlers++;
+    out->count = s->count;
+    out->unhandled = s->unhandled;
+    out->spurious = s->spurious;
+    out->samples = s->samples;
+    out->cycles_min = s->cycles_min;
+    out->cycles_max = s->cycles_max;
+    out->cycles_total = s->cycles_total;
+    out->storms = s->storms;
+    out->storming = s->storming;
+    return 0;
+}
+
+void irq_reset_stats() {
+    uint64_t flags = irq_save();
+    for (int i = 0; i < IRQ_LINES; i++) {
+        irq_line_stats_t* s = &stats[i];
+        s->count = 0;
+        s->unhandled = 0;
+        s->spurious = 0;
+        s->samples = 0;
+        s->cycles_min = 0;
+        s->cycles_max = 0;
+        s->cycles_total = 0;
+        s->storms = 0;
+        s->window_count = 0;
+        s->storming = 0;
+    }
+    irq_restore(flags);
+}
+
+// Lines no controller input drives, for message signalled interrupts. A
+// multi-message MSI block rewrites the low bits of its vector, hence the
+// alignment; vector 0x20 + line keeps it for blocks up to 32.
+int irq_alloc_lines(uint32_t count) {
+    if (count == 0 || (count & (count - 1))) return -1;
+
+    uint64_t flags = irq_save();
+    // Past every line the controller drives, a second I/O APIC's GSIs included
+    uint32_t start = chip->lines > IRQ_DYNAMIC_FIRST ? chip->lines : IRQ_DYNAMIC_FIRST;
+    start = (start + count - 1) & ~(count - 1);
+    for (uint32_t first = start; first + count <= IRQ_LINES; first += count) {
+        uint32_t n = 0;
+        while (n < count && !allocated[first + n] && !lines[first + n] &&
+               !chip->spurious(first + n)) {
+            n++;
+        }
+        if (n < count) continue;
+
+        for (n = 0; n < count; n++) allocated[first + n] = 1;
+        irq_restore(flags);
+        return first;
+    }
+    irq_restore(flags);
+    return -1;
+}
+
+void irq_free_lines(uint8_t first, uint32_t count) {
+    for (uint32_t n = 0; n < count && first + n < IRQ_LINES; n++) allocated[first + n] = 0;
+}
+
+static int register_line(uint8_t line, int trigger, irq_handler_t handler, void* ctx) {
+    if (line >= IRQ_LINES || !handler) return -1;
+
+    uint64_t flags = irq_save();
+    // A shared line has one trigger mode; every device on it must agree
+    if (lines[line] && triggers[line] != trigger) {
+        irq_restore(flags);
+        return -1;
+    }
+    irq_action_t* action = 0;
+    for (int i = 0; i < IRQ_ACTIONS_MAX; i++) {
+        if (!actions[i].handler) {
+            action = &actions[i];
+            break;
+        }
+    }
+    if (!action) {
+        irq_restore(flags);
+        return -1;
+    }
+
+    action->handler = handler;
+    action->ctx = ctx;
+    action->next = 0;
+
+    // Appended, so handlers on a shared line run in registration order
+    irq_action_t** link = &lines[line];
+    while (*link) link = &(*link)->next;
+    *link = action;
+    triggers[line] = (uint8_t)trigger;
+
+    // Allocated lines have no controller input; the device itself masks them
+    if (line < chip->lines && !allocated[line]) chip->unmask(line, trigger);
+    irq_restore(flags);
+    return 0;
+}
+
+int irq_register(uint8_t line, irq_handler_t handler, void* ctx) {
+    return register_line(line, IRQ_TRIGGER_EDGE, handler, ctx);
+}
+
+int irq_register_level(uint8_t line, irq_handler_t handler, void* ctx) {
+    return register_line(line, IRQ_TRIGGER_LEVEL, handler, ctx);
+}
+
+void irq_unregister(uint8_t line, irq_handler_t handler, void* ctx) {
+    if (line >= IRQ_LINES) return;
+
+    uint64_t flags = irq_save();
+    for (irq_action_t** link = &lines[line]; *link; link = &(*link)->next) {
+        irq_action_t* action = *link;
+        if (action->handler == handler && action->ctx == ctx) {
+            *link = action->next;
+            action->handler = 0;
+            break;
+        }
+    }
+    if (!lines[line] && line < chip->lines && !allocated[line]) chip->mask(line);
+    irq_restore(flags);
+}
+
+// Flags a line that fires more than IRQ_STORM_RATE times in a second;
+// the flag clears after a quiet second
+static void storm_check(irq_line_stats_t* s) {
+    storm_expire(s, get_tick());
+    if (++s->window_count == IRQ_STORM_RATE + 1) {
+        s->storms++;
+        s->storming = 1;
+    }
+}
+
+void irq_dispatch(uint64_t line) {
+    irq_line_stats_t* s = &stats[line];
+    if (chip->spurious(line)) {
+        s->spurious++;
+        return;
+    }
+
+    uint64_t start = sampling ? rdtsc() : 0;   // 0 = not timed
+
+    int handled = IRQ_NONE;
+    for (irq_action_t* action = lines[line]; action; action = action->next) {
+        handled |= action->handler(action->ctx);
+    }
+
+    chip->eoi(line);
+
+    if (start) {
+        uint64_t cycles = rdtsc() - start;
+        if (!s->samples || cycles < s->cycles_min) s->cycles_min = cycles;
+        if (cycles > s->cycles_max) s->cycles_max = cycles;
+        s->cycles_total += cycles;
+        s->samples++;
+    }
+    s->count++;
+    if (handled == IRQ_NONE) s->unhandled++;
+    storm_check(s);
+
+    // Deferred work runs now, with the line acknowledged and interrupts on
+    softirq_run();
+}
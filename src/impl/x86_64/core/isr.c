@@ -1,10 +1,19 @@
+#include "core/isr.h"
 #include "drivers/keyboard.h"
+#include "drivers/vmregion.h"
+#include "lib/print.h"
 
-extern void irq1_stub();
-extern void keyboard_handler();
+// Page faults land here from page_fault_stub. Demand-paged regions are
+// filled in and the access retried; anything else is a kernel bug, so
+// report it and stop instead of letting it escalate to a triple fault.
+void isr_page_fault(uint64_t error, uint64_t rip) {
+    uint64_t addr;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(addr));
 
-void isr_keyboard() {
-    keyboard_handler();
-    // Send EOI
-    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0x20), "Nd"((uint16_t)0x20));
+    if (vm_region_fault(addr, error) == 0) return;
+
+    kprintf("\nPAGE FAULT at 0x%lx, rip 0x%lx, error 0x%lx (%s, %s)\n", addr, rip, error,
+            (error & 0x1) ? "protection" : "not present",
+            (error & 0x2) ? "write" : "read");
+    for (;;) __asm__ volatile("cli; hlt");
 }
@@ -0,0 +1,93 @@
+#include "core/softirq.h"
+#include "../lib/cpu.h"
+#include <stdint.h>
+
+typedef struct {
+    softirq_fn_t fn;
+    void* ctx;
+    softirq_info_t info;
+} softirq_t;
+
+static softirq_t softirqs[SOFTIRQ_MAX];
+static int softirq_count = 0;
+
+static volatile uint32_t pending = 0;   // Bit per id
+static volatile int running = 0;
+static volatile int disabled = 0;       // softirq_disable depth
+static uint64_t deferred = 0;
+
+int softirq_register(const char* name, softirq_fn_t fn, void* ctx) {
+    if (softirq_count >= SOFTIRQ_MAX || !fn) return -1;
+
+    softirq_t* s = &softirqs[softirq_count];
+    s->fn = fn;
+    s->ctx = ctx;
+    s->info.name = name;
+    s->info.raised = 0;
+    s->info.runs = 0;
+    s->info.cycles = 0;
+    s->info.max_cycles = 0;
+    return softirq_count++;
+}
+
+void softirq_raise(int id) {
+    if (id < 0 || id >= softirq_count) return;
+    softirqs[id].info.raised++;
+    __atomic_or_fetch(&pending, 1u << id, __ATOMIC_SEQ_CST);
+}
+
+int softirq_pending() {
+    return pending != 0;
+}
+
+void softirq_disable() {
+    disabled++;
+}
+
+void softirq_enable() {
+    if (disabled > 0) disabled--;
+}
+
+void softirq_run() {
+    // An interrupt taken while softirqs run must not start them again
+    if (running || disabled || !pending) return;
+    running = 1;
+
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; sti" : "=r"(flags) :: "memory");
+
+    for (int pass = 0; pass < SOFTIRQ_RESTARTS && pending; pass++) {
+        uint32_t work = __atomic_exchange_n(&pending, 0, __ATOMIC_SEQ_CST);
+        for (int id = 0; work; id++, work >>= 1) {
+            if (!(work & 1)) continue;
+
+            softirq_t* s = &softirqs[id];
+            uint64_t start = rdtsc();
+            s->fn(s->ctx);
+            uint64_t cycles = rdtsc() - start;
+
+            s->info.runs++;
+            s->info.cycles += cycles;
+            if (cycles > s->info.max_cycles) s->info.max_cycles = cycles;
+        }
+    }
+
+    __asm__ volatile("cli" ::: "memory");
+    if (pending) deferred++;
+    running = 0;
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+int softirq_get_info(int id, softirq_info_t* info) {
+    if (id < 0 || id >= softirq_count) return -1;
+    info->name = softirqs[id].info.name;
+    info->raised = softirqs[id].info.raised;
+    info->runs = softirqs[id].info.runs;
+    info->cycles = softirqs[id].info.cycles;
+    info->max_cycles = softirqs[id].info.max_cycles;
+    return 0;
+}
+
+uint64_t softirq_get_deferred() {
+    return deferred;
+}
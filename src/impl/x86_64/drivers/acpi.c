@@ -0,0 +1,107 @@
+// acpi.c - RSDP discovery and table lookup
+#include "drivers/acpi.h"
+#include "drivers/paging.h"
+#include "core/multiboot2.h"
+#include "lib/string.h"
+#include <stdint.h>
+
+struct acpi_rsdp {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;       // First 20 bytes
+    char oem_id[6];
+    uint8_t revision;       // 0 = ACPI 1.0, RSDT only
+    uint32_t rsdt_address;
+    uint32_t length;        // From here on ACPI 2.0+
+    uint64_t xsdt_address;
+    uint8_t ext_checksum;   // Whole structure
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+#define RSDP_V1_SIZE 20
+
+// Root table, physical; the XSDT holds 64-bit entries, the RSDT 32-bit ones
+static uint64_t root_phys = 0;
+static int root_is_xsdt = 0;
+
+static uint8_t checksum(const void* data, uint32_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += p[i];
+    return sum;
+}
+
+static int use_rsdp(const struct acpi_rsdp* rsdp) {
+    if (strncmp(rsdp->signature, "RSD PTR ", 8) != 0) return -1;
+    if (checksum(rsdp, RSDP_V1_SIZE) != 0) return -1;
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address &&
+        checksum(rsdp, sizeof(struct acpi_rsdp)) == 0) {
+        root_phys = rsdp->xsdt_address;
+        root_is_xsdt = 1;
+    } else {
+        root_phys = rsdp->rsdt_address;
+        root_is_xsdt = 0;
+    }
+    return 0;
+}
+
+// The RSDP sits on a 16-byte boundary
+static int scan_rsdp(uint64_t phys, uint64_t len) {
+    for (uint64_t off = 0; off + RSDP_V1_SIZE <= len; off += 16) {
+        if (use_rsdp((const struct acpi_rsdp*)phys_to_virt(phys + off)) == 0) return 0;
+    }
+    return -1;
+}
+
+int acpi_init(uint64_t multiboot_info) {
+    // GRUB hands over a copy; prefer the 2.0 one when both are there
+    if (multiboot_info) {
+        struct multiboot2_info* info = (struct multiboot2_info*)phys_to_virt(multiboot_info);
+        uint8_t* tag_ptr = (uint8_t*)(info + 1);
+        uint8_t* info_end = (uint8_t*)info + info->total_size;
+        const struct acpi_rsdp* old_rsdp = 0;
+
+        while (tag_ptr + sizeof(struct multiboot2_tag) <= info_end) {
+            struct multiboot2_tag* tag = (struct multiboot2_tag*)tag_ptr;
+            if (tag->type == MULTIBOOT2_TAG_END || tag->size < sizeof(struct multiboot2_tag)) break;
+
+            const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)(tag + 1);
+            if (tag->type == MULTIBOOT2_TAG_ACPI_NEW && use_rsdp(rsdp) == 0) return 0;
+            if (tag->type == MULTIBOOT2_TAG_ACPI_OLD) old_rsdp = rsdp;
+            tag_ptr += (tag->size + 7) & ~7U;
+        }
+        if (old_rsdp && use_rsdp(old_rsdp) == 0) return 0;
+    }
+
+    // First KB of the EBDA (its segment is at 0x40E), then the BIOS ROM
+    uint64_t ebda = (uint64_t)*(volatile uint16_t*)phys_to_virt(0x40E) << 4;
+    if (ebda && scan_rsdp(ebda, 1024) == 0) return 0;
+    return scan_rsdp(0xE0000, 0x20000);
+}
+
+// Firmware tables live in reserved memory the direct map skipped
+static struct acpi_sdt_header* map_table(uint64_t phys) {
+    struct acpi_sdt_header* h = paging_map_phys(phys, sizeof(struct acpi_sdt_header), PAGE_PRESENT);
+    if (!h || h->length < sizeof(struct acpi_sdt_header)) return 0;
+    if (!paging_map_phys(phys, h->length, PAGE_PRESENT)) return 0;
+    if (checksum(h, h->length) != 0) return 0;
+    return h;
+}
+
+struct acpi_sdt_header* acpi_find_table(const char* signature) {
+    if (!root_phys) return 0;
+
+    struct acpi_sdt_header* root = map_table(root_phys);
+    if (!root) return 0;
+
+    uint32_t entry_size = root_is_xsdt ? 8 : 4;
+    uint32_t entries = (root->length - sizeof(struct acpi_sdt_header)) / entry_size;
+    uint8_t* entry = (uint8_t*)(root + 1);
+
+    for (uint32_t i = 0; i < entries; i++, entry += entry_size) {
+        uint64_t phys = root_is_xsdt ? *(uint64_t*)entry : *(uint32_t*)entry;
+        struct acpi_sdt_header* h = paging_map_phys(phys, sizeof(struct acpi_sdt_header), PAGE_PRESENT);
+        if (h && strncmp(h->signature, signature, 4) == 0) return map_table(phys);
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+// apic.c - Local APIC and I/O APIC interrupt routing
+#include "drivers/apic.h"
+#include "drivers/acpi.h"
+#include "drivers/paging.h"
+#include "drivers/pic.h"
+#include "core/irq.h"
+#include "lib/print.h"
+#include "../lib/cpu.h"
+#include <stdint.h>
+
+#define IA32_APIC_BASE     0x1B
+#define APIC_BASE_X2APIC   (1ULL << 10)
+#define APIC_BASE_ENABLE   (1ULL << 11)
+#define X2APIC_MSR_BASE    0x800        // MSR = base + MMIO offset / 16
+#define X2APIC_SELF_IPI    0x83F
+
+// Local APIC registers, as MMIO offsets
+#define LAPIC_ID           0x20
+#define LAPIC_TPR          0x80
+#define LAPIC_EOI          0xB0
+#define LAPIC_SVR          0xF0
+#define LAPIC_ICR_LOW      0x300
+#define LAPIC_ICR_HIGH     0x310
+#define LAPIC_LVT_TIMER    0x320
+#define LAPIC_LVT_LINT0    0x350
+#define LAPIC_LVT_ERROR    0x370
+
+#define SVR_ENABLE         0x100
+#define LVT_MASKED         (1 << 16)
+#define ICR_PENDING        (1 << 12)
+#define ICR_ASSERT         (1 << 14)
+#define ICR_SELF           (1 << 18)
+
+// I/O APIC: an index register and a data window
+#define IOAPIC_REGSEL      0
+#define IOAPIC_WIN         4            // In 32-bit words
+#define IOAPIC_VER         0x01
+#define IOAPIC_REDIR       0x10         // Entry n: 0x10 + 2n (low), + 1 (high)
+
+#define REDIR_LOW_ACTIVE   (1 << 13)
+#define REDIR_LEVEL        (1 << 15)
+#define REDIR_MASKED       (1 << 16)
+
+// MADT entries
+#define MADT_IOAPIC        1
+#define MADT_OVERRIDE      2
+#define MADT_LAPIC_ADDR    5
+
+// MPS INTI flags on a source override
+#define INTI_POLARITY_MASK 0x3
+#define INTI_ACTIVE_LOW    0x3
+#define INTI_TRIGGER_MASK  0xC
+#define INTI_LEVEL         0xC
+
+#define IOAPIC_MAX 4
+#define ISA_LINES  16
+
+struct madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    // Variable-length entries follow: type, length, body
+} __attribute__((packed));
+
+typedef struct {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t gsis;
+} ioapic_t;
+
+static ioapic_t ioapics[IOAPIC_MAX];
+static int ioapic_count = 0;
+
+// ISA IRQ to GSI, with the override's polarity and trigger
+static uint32_t isa_gsi[ISA_LINES];
+static uint16_t isa_flags[ISA_LINES];
+static uint8_t isa_override[ISA_LINES];    // The MADT had an entry for the line
+
+static volatile uint8_t* lapic = 0;
+static int use_x2apic = 0;
+static int active = 0;
+static uint32_t lapic_id = 0;
+
+static uint32_t lapic_read(uint32_t reg) {
+    if (use_x2apic) return (uint32_t)rdmsr(X2APIC_MSR_BASE + (reg >> 4));
+    return *(volatile uint32_t*)(lapic + reg);
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    if (use_x2apic) wrmsr(X2APIC_MSR_BASE + (reg >> 4), value);
+    else *(volatile uint32_t*)(lapic + reg) = value;
+}
+
+static uint32_t ioapic_read(ioapic_t* io, uint32_t reg) {
+    io->regs[IOAPIC_REGSEL] = reg;
+    return io->regs[IOAPIC_WIN];
+}
+
+static void ioapic_write(ioapic_t* io, uint32_t reg, uint32_t value) {
+    io->regs[IOAPIC_REGSEL] = reg;
+    io->regs[IOAPIC_WIN] = value;
+}
+
+static ioapic_t* ioapic_for(uint32_t gsi) {
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapic_t* io = &ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->gsis) return io;
+    }
+    return 0;
+}
+
+// ISA lines go through the overrides; anything above is a GSI already
+static uint32_t line_gsi(uint8_t line) {
+    return line < ISA_LINES ? isa_gsi[line] : line;
+}
+
+static void apic_unmask(uint8_t line, int trigger) {
+    uint32_t gsi = line_gsi(line);
+    ioapic_t* io = ioapic_for(gsi);
+    if (!io) return;
+
+    // The firmware's override knows the wiring best; otherwise the driver
+    // says: edge, active high for ISA devices, level, active low for PCI
+    uint32_t low = IRQ_BASE_VECTOR + line;
+    uint16_t flags;
+    if (line < ISA_LINES && isa_override[line]) flags = isa_flags[line];
+    else if (trigger == IRQ_TRIGGER_LEVEL) flags = INTI_ACTIVE_LOW | INTI_LEVEL;
+    else flags = 0;
+    if ((flags & INTI_POLARITY_MASK) == INTI_ACTIVE_LOW) low |= REDIR_LOW_ACTIVE;
+    if ((flags & INTI_TRIGGER_MASK) == INTI_LEVEL) low |= REDIR_LEVEL;
+
+    uint32_t entry = IOAPIC_REDIR + 2 * (gsi - io->gsi_base);
+    ioapic_write(io, entry + 1, lapic_id << 24);    // Physical destination: this CPU
+    ioapic_write(io, entry, low);
+}
+
+static void apic_mask(uint8_t line) {
+    uint32_t gsi = line_gsi(line);
+    ioapic_t* io = ioapic_for(gsi);
+    if (!io) return;
+
+    uint32_t entry = IOAPIC_REDIR + 2 * (gsi - io->gsi_base);
+    ioapic_write(io, entry, ioapic_read(io, entry) | REDIR_MASKED);
+}
+
+void apic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void apic_line_eoi(uint8_t line) {
+    apic_eoi();
+}
+
+// The spurious vector is never in service, so it takes no EOI
+static int apic_spurious(uint8_t line) {
+    return line == APIC_SPURIOUS_VECTOR - IRQ_BASE_VECTOR;
+}
+
+static irq_chip_t apic_chip = {
+    .name = "I/O APIC",
+    .lines = 0,     // GSIs the I/O APICs cover, set by apic_init
+    .unmask = apic_unmask,
+    .mask = apic_mask,
+    .eoi = apic_line_eoi,
+    .spurious = apic_spurious,
+};
+
+static void parse_madt(struct madt* madt, uint64_t* lapic_phys) {
+    *lapic_phys = madt->lapic_address;
+
+    uint8_t* p = (uint8_t*)(madt + 1);
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2) {
+        if (p[0] == MADT_IOAPIC && ioapic_count < IOAPIC_MAX) {
+            ioapic_t* io = &ioapics[ioapic_count++];
+            io->regs = (volatile uint32_t*)(uint64_t)*(uint32_t*)(p + 4);     // Physical for now
+            io->gsi_base = *(uint32_t*)(p + 8);
+        } else if (p[0] == MADT_OVERRIDE && p[3] < ISA_LINES) {
+            isa_gsi[p[3]] = *(uint32_t*)(p + 4);
+            isa_flags[p[3]] = *(uint16_t*)(p + 8);
+            isa_override[p[3]] = 1;
+        } else if (p[0] == MADT_LAPIC_ADDR) {
+            *lapic_phys = *(uint64_t*)(p + 4);
+        }
+        p += p[1];
+    }
+}
+
+int apic_init() {
+    // APIC: CPUID leaf 1, EDX bit 9; x2APIC: ECX bit 21
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if (!((edx >> 9) & 1)) return -1;
+
+    struct madt* madt = (struct madt*)acpi_find_table("APIC");
+    if (!madt) return -1;
+
+    for (int i = 0; i < ISA_LINES; i++) {
+        isa_gsi[i] = i;
+        isa_flags[i] = 0;
+        isa_override[i] = 0;
+    }
+    uint64_t lapic_phys;
+    parse_madt(madt, &lapic_phys);
+    if (ioapic_count == 0) return -1;
+
+    uint32_t mmio = PAGE_PRESENT | PAGE_RW | PAGE_PCD | PAGE_PWT;
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapic_t* io = &ioapics[i];
+        io->regs = (volatile uint32_t*)paging_map_phys((uint64_t)io->regs, PAGE_SIZE, mmio);
+        if (!io->regs) return -1;
+        io->gsis = ((ioapic_read(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+    }
+
+    // xAPIC mode has to be on before x2APIC can be
+    use_x2apic = (ecx >> 21) & 1;
+    uint64_t base = rdmsr(IA32_APIC_BASE) | APIC_BASE_ENABLE;
+    wrmsr(IA32_APIC_BASE, base);
+    if (use_x2apic) {
+        wrmsr(IA32_APIC_BASE, base | APIC_BASE_X2APIC);
+        lapic_id = lapic_read(LAPIC_ID);
+    } else {
+        lapic = (volatile uint8_t*)paging_map_phys(lapic_phys, PAGE_SIZE, mmio);
+        if (!lapic) return -1;
+        lapic_id = lapic_read(LAPIC_ID) >> 24;
+    }
+
+    // Nothing comes in through LINT0 (the PIC's ExtINT) or the LAPIC timer
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    // Every redirection entry starts masked; apic_unmask fills in the rest
+    uint32_t lines = 0;
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapic_t* io = &ioapics[i];
+        for (uint32_t n = 0; n < io->gsis; n++) {
+            ioapic_write(io, IOAPIC_REDIR + 2 * n, REDIR_MASKED);
+        }
+        if (io->gsi_base + io->gsis > lines) lines = io->gsi_base + io->gsis;
+    }
+    apic_chip.lines = lines < IRQ_LINES ? lines : IRQ_LINES;
+
+    pic_disable();
+    irq_set_chip(&apic_chip);
+    active = 1;
+
+    kprintf("[APIC] %s, LAPIC id %u, %u I/O APIC(s), %u GSIs\n",
+            use_x2apic ? "x2APIC" : "xAPIC", lapic_id, ioapic_count, lines);
+    return 0;
+}
+
+int apic_active() {
+    return active;
+}
+
+int apic_x2apic() {
+    return use_x2apic;
+}
+
+uint32_t apic_id() {
+    return lapic_id;
+}
+
+void apic_send_self(uint8_t vector) {
+    if (use_x2apic) {
+        wrmsr(X2APIC_SELF_IPI, vector);
+        return;
+    }
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) { }
+    lapic_write(LAPIC_ICR_HIGH, 0);
+    lapic_write(LAPIC_ICR_LOW, ICR_SELF | ICR_ASSERT | vector);
+}
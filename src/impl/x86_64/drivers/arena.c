@@ -0,0 +1,150 @@
+// arena.c
+#include "drivers/arena.h"
+#include "drivers/heap.h"
+#include <stdint.h>
+
+struct karena_chunk {
+    struct karena_chunk* next;  // Older chunk
+    uint64_t size;              // Usable bytes after this header
+    uint64_t used;
+};
+
+typedef struct arena_object {
+    struct arena_object* next;
+} arena_object_t;
+
+#define ARENA_ALIGN(size) (((size) + 7) & ~7ULL)   // Same alignment kmalloc gives
+#define CHUNK_HEADER ARENA_ALIGN(sizeof(karena_chunk_t))
+#define CHUNK_DATA(c) ((uint8_t*)(c) + CHUNK_HEADER)
+
+static karena_chunk_t* chunk_new(karena_t* arena, uint64_t size) {
+    karena_chunk_t* chunk = (karena_chunk_t*)kmalloc(CHUNK_HEADER + size);
+    if (!chunk) return 0;
+    chunk->next = 0;
+    chunk->size = size;
+    chunk->used = 0;
+    if (arena) arena->heap_calls++;
+    return chunk;
+}
+
+karena_t* karena_create(uint64_t chunk_size) {
+    if (chunk_size == 0) chunk_size = KARENA_DEFAULT_CHUNK;
+    chunk_size = ARENA_ALIGN(chunk_size);
+
+    // The arena header lives at the start of its own first chunk
+    karena_chunk_t* chunk = chunk_new(0, chunk_size);
+    if (!chunk) return 0;
+
+    karena_t* arena = (karena_t*)CHUNK_DATA(chunk);
+    chunk->used = ARENA_ALIGN(sizeof(karena_t));
+
+    arena->head = chunk;
+    arena->first = chunk;
+    arena->objects = 0;
+    arena->chunk_size = chunk_size;
+    arena->allocs = 0;
+    arena->bytes = 0;
+    arena->heap_calls = 1;
+    return arena;
+}
+
+karena_t* karena_create_unpooled() {
+    karena_t* arena = (karena_t*)kmalloc(sizeof(karena_t));
+    if (!arena) return 0;
+
+    arena->head = 0;
+    arena->first = 0;
+    arena->objects = 0;
+    arena->chunk_size = 0;
+    arena->allocs = 0;
+    arena->bytes = 0;
+    arena->heap_calls = 1;
+    return arena;
+}
+
+static void* unpooled_alloc(karena_t* arena, uint64_t size) {
+    arena_object_t* obj = (arena_object_t*)kmalloc(sizeof(arena_object_t) + size);
+    if (!obj) return 0;
+    arena->heap_calls++;
+
+    obj->next = (arena_object_t*)arena->objects;
+    arena->objects = obj;
+    return obj + 1;
+}
+
+void* karena_alloc(karena_t* arena, uint64_t size) {
+    if (!arena || size == 0) return 0;
+    size = ARENA_ALIGN(size);
+
+    void* ptr;
+    if (arena->chunk_size == 0) {
+        ptr = unpooled_alloc(arena, size);
+    } else {
+        karena_chunk_t* chunk = arena->head;
+        if (chunk->size - chunk->used < size) {
+            // Oversized requests get a chunk of their own
+            uint64_t want = size > arena->chunk_size ? size : arena->chunk_size;
+            chunk = chunk_new(arena, want);
+            if (!chunk) return 0;
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+
+        ptr = CHUNK_DATA(chunk) + chunk->used;
+        chunk->used += size;
+    }
+
+    if (ptr) {
+        arena->allocs++;
+        arena->bytes += size;
+    }
+    return ptr;
+}
+
+char* karena_strndup(karena_t* arena, const char* str, uint64_t len) {
+    char* copy = (char*)karena_alloc(arena, len + 1);
+    if (!copy) return 0;
+    for (uint64_t i = 0; i < len; i++) {
+        copy[i] = str[i];
+    }
+    copy[len] = '\0';
+    return copy;
+}
+
+void karena_reset(karena_t* arena) {
+    if (!arena) return;
+
+    if (arena->chunk_size == 0) {
+        arena_object_t* obj = (arena_object_t*)arena->objects;
+        while (obj) {
+            arena_object_t* next = obj->next;
+            kfree(obj);
+            arena->heap_calls++;
+            obj = next;
+        }
+        arena->objects = 0;
+        return;
+    }
+
+    karena_chunk_t* chunk = arena->head;
+    while (chunk != arena->first) {
+        karena_chunk_t* next = chunk->next;
+        kfree(chunk);
+        arena->heap_calls++;
+        chunk = next;
+    }
+
+    arena->head = arena->first;
+    arena->first->used = ARENA_ALIGN(sizeof(karena_t));
+}
+
+void karena_destroy(karena_t* arena) {
+    if (!arena) return;
+
+    karena_reset(arena);
+    if (arena->chunk_size == 0) {
+        kfree(arena);
+    } else {
+        kfree(arena->first);    // Also releases the arena header
+    }
+}
@@ -1,11 +1,9 @@
 // fat32.c
 #include "drivers/fat32.h"
 #include "lib/string.h"
+#include "drivers/kmem_cache.h"
 #include <stdint.h>
 
-extern void* kmalloc(uint64_t size);
-extern void kfree(void* ptr);
-
 extern int disk_read_sectors(uint32_t lba, uint32_t count, uint8_t* buffer);
 extern int disk_write_sectors(uint32_t lba, uint32_t count, uint8_t* buffer);
 
@@ -18,6 +16,8 @@ static uint32_t data_start_sector;
 static uint32_t sectors_per_cluster;
 static uint32_t bytes_per_cluster;
 static uint8_t sector_buffer[FAT32_SECTOR_SIZE];
+static kmem_cache_t* cluster_cache;     // bytes_per_cluster buffers
+static kmem_cache_t* sector_cache;      // FAT32_SECTOR_SIZE buffers
 
 static uint32_t fat32_get_fat_entry(uint32_t cluster) {
     uint32_t fat_offset = cluster * 4;
@@ -97,6 +97,14 @@ int fat32_init(uint32_t partition_lba) {
     
     sectors_per_cluster = boot_sector.sectors_per_cluster;
     bytes_per_cluster = sectors_per_cluster * FAT32_SECTOR_SIZE;
+
+    // Scratch buffers are recycled through caches so FS calls don't churn the heap
+    if (cluster_cache) kmem_cache_destroy(cluster_cache);
+    cluster_cache = kmem_cache_create("fat32-cluster", bytes_per_cluster, 16, 0);
+    if (!sector_cache) sector_cache = kmem_cache_create("fat32-sector", FAT32_SECTOR_SIZE, 16, 0);
+    if (!cluster_cache || !sector_cache) {
+        return -3;
+    }
     
     fat_start_sector = partition_lba + boot_sector.reserved_sectors;
     
@@ -114,7 +122,7 @@ int fat32_init(uint32_t partition_lba) {
 
 static uint32_t fat32_find_file(uint32_t dir_cluster, const char* filename, 
                                 fat32_dir_entry_t* entry_out) {
-    uint8_t* cluster_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* cluster_buffer = kmem_cache_alloc(cluster_cache);
     if (!cluster_buffer) return 0;
     
     char upper_filename[256];
@@ -133,7 +141,7 @@ static uint32_t fat32_find_file(uint32_t dir_cluster, const char* filename,
     
     while (cluster < 0x0FFFFFF8) {
         if (fat32_read_cluster(cluster, cluster_buffer) != 0) {
-            kfree(cluster_buffer);
+            kmem_cache_free(cluster_cache, cluster_buffer);
             return 0;
         }
         
@@ -142,7 +150,7 @@ static uint32_t fat32_find_file(uint32_t dir_cluster, const char* filename,
         
         for (uint32_t i = 0; i < entries_per_cluster; i++) {
             if (entries[i].name[0] == 0x00) {
-                kfree(cluster_buffer);
+                kmem_cache_free(cluster_cache, cluster_buffer);
                 return 0;
             }
             
@@ -165,7 +173,7 @@ static uint32_t fat32_find_file(uint32_t dir_cluster, const char* filename,
                 }
                 uint32_t result = (entries[i].first_cluster_high << 16) | 
                                   entries[i].first_cluster_low;
-                kfree(cluster_buffer);
+                kmem_cache_free(cluster_cache, cluster_buffer);
                 // Return 1 if file exists but has no clusters (empty file)
                 return (result == 0) ? 1 : result;
             }
@@ -174,11 +182,15 @@ static uint32_t fat32_find_file(uint32_t dir_cluster, const char* filename,
         cluster = fat32_get_fat_entry(cluster);
     }
     
-    kfree(cluster_buffer);
+    kmem_cache_free(cluster_cache, cluster_buffer);
     return 0;
 }
 
 int fat32_read_file(const char* path, uint8_t* buffer, uint32_t max_size) {
+    return fat32_read_file_at(path, 0, buffer, max_size);
+}
+
+int fat32_read_file_at(const char* path, uint32_t offset, uint8_t* buffer, uint32_t max_size) {
     fat32_dir_entry_t entry;
     
     // Initialize entry
@@ -216,16 +228,23 @@ int fat32_read_file(const char* path, uint8_t* buffer, uint32_t max_size) {
     
     uint32_t file_size = entry.file_size;
     
-    // Handle empty files
-    if (file_size == 0 || cluster == 0) {
+    // Handle empty files, and reads starting at or past the end
+    if (file_size == 0 || cluster == 0 || offset >= file_size) {
         return 0;  // Successfully read 0 bytes
     }
     
+    file_size -= offset;
     if (file_size > max_size) {
         file_size = max_size;
     }
     
-    uint8_t* temp_cluster = kmalloc(bytes_per_cluster);
+    // Clusters wholly before the offset are only followed in the FAT, not read
+    for (uint32_t skip = offset / bytes_per_cluster; skip > 0 && cluster < 0x0FFFFFF8; skip--) {
+        cluster = fat32_get_fat_entry(cluster);
+    }
+    uint32_t cluster_offset = offset % bytes_per_cluster;
+    
+    uint8_t* temp_cluster = kmem_cache_alloc(cluster_cache);
     if (!temp_cluster) {
         return -3;
     }
@@ -234,29 +253,30 @@ int fat32_read_file(const char* path, uint8_t* buffer, uint32_t max_size) {
     
     while (cluster < 0x0FFFFFF8 && bytes_read < file_size) {
         if (fat32_read_cluster(cluster, temp_cluster) != 0) {
-            kfree(temp_cluster);
+            kmem_cache_free(cluster_cache, temp_cluster);
             return -2;
         }
         
-        uint32_t to_copy = bytes_per_cluster;
+        uint32_t to_copy = bytes_per_cluster - cluster_offset;
         if (bytes_read + to_copy > file_size) {
             to_copy = file_size - bytes_read;
         }
         
         for (uint32_t i = 0; i < to_copy; i++) {
-            buffer[bytes_read + i] = temp_cluster[i];
+            buffer[bytes_read + i] = temp_cluster[cluster_offset + i];
         }
         
         bytes_read += to_copy;
+        cluster_offset = 0;
         cluster = fat32_get_fat_entry(cluster);
     }
     
-    kfree(temp_cluster);
-    return file_size;
+    kmem_cache_free(cluster_cache, temp_cluster);
+    return bytes_read;
 }
 
 int fat32_list_directory(fat32_file_info_t* files, uint32_t max_files) {
-    uint8_t* cluster_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* cluster_buffer = kmem_cache_alloc(cluster_cache);
     if (!cluster_buffer) return -1;
     
     uint32_t cluster = current_directory_cluster ? current_directory_cluster : boot_sector.root_cluster;
@@ -294,7 +314,7 @@ int fat32_list_directory(fat32_file_info_t* files, uint32_t max_files) {
         cluster = fat32_get_fat_entry(cluster);
     }
     
-    kfree(cluster_buffer);
+    kmem_cache_free(cluster_cache, cluster_buffer);
     return file_count;
 }
 
@@ -322,11 +342,11 @@ static int fat32_set_fat_entry(uint32_t cluster, uint32_t value) {
     uint32_t fat_sector = fat_start_sector + (fat_offset / FAT32_SECTOR_SIZE);
     uint32_t entry_offset = fat_offset % FAT32_SECTOR_SIZE;
     
-    uint8_t* buffer = kmalloc(512);
+    uint8_t* buffer = kmem_cache_alloc(sector_cache);
     if (!buffer) return -1;
     
     if (disk_read_sectors(fat_sector, 1, buffer) != 0) {
-        kfree(buffer);
+        kmem_cache_free(sector_cache, buffer);
         return -1;
     }
     
@@ -341,7 +361,7 @@ static int fat32_set_fat_entry(uint32_t cluster, uint32_t value) {
         disk_write_sectors(backup_fat_sector, 1, buffer);
     }
     
-    kfree(buffer);
+    kmem_cache_free(sector_cache, buffer);
     return result;
 }
 
@@ -421,7 +441,7 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
         file_cluster = fat32_alloc_cluster();
         if (file_cluster == 0) return -4;
         
-        uint8_t* dir_buffer = kmalloc(bytes_per_cluster);
+        uint8_t* dir_buffer = kmem_cache_alloc(cluster_cache);
         if (!dir_buffer) return -5;
         
         if (fat32_read_cluster(dir_cluster, dir_buffer) == 0) {
@@ -444,10 +464,10 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
                 }
             }
         }
-        kfree(dir_buffer);
+        kmem_cache_free(cluster_cache, dir_buffer);
     }
     
-    uint8_t* temp_cluster = kmalloc(bytes_per_cluster);
+    uint8_t* temp_cluster = kmem_cache_alloc(cluster_cache);
     if (!temp_cluster) return -3;
     
     for (uint32_t i = 0; i < bytes_per_cluster; i++) {
@@ -469,7 +489,7 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
         }
         int res = fat32_write_cluster(current_cluster, temp_cluster);
         if (res != 0) {
-            kfree(temp_cluster);
+            kmem_cache_free(cluster_cache, temp_cluster);
             return res*10;
         }
         
@@ -482,7 +502,7 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
             if (current_cluster >= 0x0FFFFFF8) {
                 current_cluster = fat32_alloc_cluster();
                 if (current_cluster == 0) {
-                    kfree(temp_cluster);
+                    kmem_cache_free(cluster_cache, temp_cluster);
                     return -4;
                 }
                 fat32_set_fat_entry(prev_cluster, current_cluster);
@@ -490,9 +510,9 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
         }
     }
     
-    uint8_t* dir_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* dir_buffer = kmem_cache_alloc(cluster_cache);
     if (!dir_buffer) {
-        kfree(temp_cluster);
+        kmem_cache_free(cluster_cache, temp_cluster);
         return -5;
     }
     
@@ -516,8 +536,8 @@ int fat32_write_file(const char* path, const uint8_t* buffer, uint32_t size) {
         }
     }
     
-    kfree(dir_buffer);
-    kfree(temp_cluster);
+    kmem_cache_free(cluster_cache, dir_buffer);
+    kmem_cache_free(cluster_cache, temp_cluster);
     return size;
 }
 
@@ -562,7 +582,7 @@ int fat32_delete_file(const char* path) {
     }
     
     // Mark directory entry as deleted
-    uint8_t* dir_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* dir_buffer = kmem_cache_alloc(cluster_cache);
     if (!dir_buffer) return -2;
     
     if (fat32_read_cluster(dir_cluster, dir_buffer) == 0) {
@@ -586,7 +606,7 @@ int fat32_delete_file(const char* path) {
         }
     }
     
-    kfree(dir_buffer);
+    kmem_cache_free(cluster_cache, dir_buffer);
     return 0;
 }
 
@@ -639,7 +659,7 @@ static int parse_path(const char* path, path_component_t* components, uint32_t*
 }
 
 static uint32_t find_directory(uint32_t parent_cluster, const char* name) {
-    uint8_t* cluster_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* cluster_buffer = kmem_cache_alloc(cluster_cache);
     if (!cluster_buffer) return 0;
     
     uint8_t fat_name[11];
@@ -649,7 +669,7 @@ static uint32_t find_directory(uint32_t parent_cluster, const char* name) {
     
     while (cluster < 0x0FFFFFF8) {
         if (fat32_read_cluster(cluster, cluster_buffer) != 0) {
-            kfree(cluster_buffer);
+            kmem_cache_free(cluster_cache, cluster_buffer);
             return 0;
         }
         
@@ -658,7 +678,7 @@ static uint32_t find_directory(uint32_t parent_cluster, const char* name) {
         
         for (uint32_t i = 0; i < entries_per_cluster; i++) {
             if (entries[i].name[0] == 0x00) {
-                kfree(cluster_buffer);
+                kmem_cache_free(cluster_cache, cluster_buffer);
                 return 0;
             }
             
@@ -678,7 +698,7 @@ static uint32_t find_directory(uint32_t parent_cluster, const char* name) {
             if (match) {
                 uint32_t result = (entries[i].first_cluster_high << 16) | 
                                   entries[i].first_cluster_low;
-                kfree(cluster_buffer);
+                kmem_cache_free(cluster_cache, cluster_buffer);
                 return result;
             }
         }
@@ -686,7 +706,7 @@ static uint32_t find_directory(uint32_t parent_cluster, const char* name) {
         cluster = fat32_get_fat_entry(cluster);
     }
     
-    kfree(cluster_buffer);
+    kmem_cache_free(cluster_cache, cluster_buffer);
     return 0;
 }
 
@@ -707,12 +727,12 @@ int fat32_create_file(const char* path) {
     }
     
     // Allocate cluster buffer
-    uint8_t* cluster_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* cluster_buffer = kmem_cache_alloc(cluster_cache);
     if (!cluster_buffer) return -1;
 
     // Read current directory
     if (fat32_read_cluster(dir_cluster, cluster_buffer) != 0) {
-        kfree(cluster_buffer);
+        kmem_cache_free(cluster_cache, cluster_buffer);
         return -2;
     }
     
@@ -744,12 +764,12 @@ int fat32_create_file(const char* path) {
             
             // Write directory back
             int result = fat32_write_cluster(dir_cluster, cluster_buffer);
-            kfree(cluster_buffer);
+            kmem_cache_free(cluster_cache, cluster_buffer);
             return result;
         }
     }
     
-    kfree(cluster_buffer);
+    kmem_cache_free(cluster_cache, cluster_buffer);
     return -3;  // No empty slots
 }
 
@@ -894,7 +914,7 @@ int fat32_mkdir(const char* path) {
     }
     
     // Initialize directory cluster with . and ..
-    uint8_t* dir_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* dir_buffer = kmem_cache_alloc(cluster_cache);
     if (!dir_buffer) {
         fat32_set_fat_entry(new_cluster, 0);
         return -2;
@@ -923,10 +943,10 @@ int fat32_mkdir(const char* path) {
     entries[1].first_cluster_high = (current_directory_cluster >> 16) & 0xFFFF;
     
     fat32_write_cluster(new_cluster, dir_buffer);
-    kfree(dir_buffer);
+    kmem_cache_free(cluster_cache, dir_buffer);
     
     // Add entry to parent directory
-    uint8_t* parent_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* parent_buffer = kmem_cache_alloc(cluster_cache);
     if (!parent_buffer) {
         return -3;
     }
@@ -955,7 +975,7 @@ int fat32_mkdir(const char* path) {
         }
     }
     
-    kfree(parent_buffer);
+    kmem_cache_free(cluster_cache, parent_buffer);
     return 0;
 }
 
@@ -970,7 +990,7 @@ int fat32_list_directory_ex(const char* path, fat32_file_info_t* files, uint32_t
         }
     }
     
-    uint8_t* cluster_buffer = kmalloc(bytes_per_cluster);
+    uint8_t* cluster_buffer = kmem_cache_alloc(cluster_cache);
     if (!cluster_buffer) return -1;
     
     uint32_t cluster = target_cluster;
@@ -986,7 +1006,7 @@ int fat32_list_directory_ex(const char* path, fat32_file_info_t* files, uint32_t
         
         for (uint32_t i = 0; i < entries_per_cluster && file_count < max_files; i++) {
             if (entries[i].name[0] == 0x00) {
-                kfree(cluster_buffer);
+                kmem_cache_free(cluster_cache, cluster_buffer);
                 return file_count;
             }
             
@@ -1009,6 +1029,6 @@ int fat32_list_directory_ex(const char* path, fat32_file_info_t* files, uint32_t
         cluster = fat32_get_fat_entry(cluster);
     }
     
-     kfree(cluster_buffer);
+     kmem_cache_free(cluster_cache, cluster_buffer);
     return file_count;
 }
\ No newline at end of file
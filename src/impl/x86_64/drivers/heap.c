@@ -1,118 +1,550 @@
 // heap.c
 #include "drivers/heap.h"
 #include "drivers/memory.h"
+#include "drivers/paging.h"
+#include "heap_internal.h"
 #include <stdint.h>
 
-typedef struct block_header {
-    uint64_t size;
-    uint8_t is_free;
-    struct block_header* next;
-} block_header_t;
+// ===== SLAB FRONT-END =====
+//
+// Requests up to SLAB_MAX_SIZE are served from per-class slabs. Every slab
+// object is prefixed by one tag word holding its slab address with bit 0 set;
+// kmalloc_aligned results carry the address of their underlying block with
+// bit 1 set; block headers end with a magic that has both bits clear. kfree
+// tells them apart by looking at the word just before the pointer.
+
+typedef struct slab {
+    struct slab* next;          // Links in the class partial list
+    struct slab* prev;
+    void* free_objects;         // Freed slots, linked through their payload
+    uint32_t class_idx;
+    uint32_t in_use;
+    uint32_t carved;            // Slots handed out at least once
+    uint32_t capacity;
+} slab_t;
+
+typedef struct {
+    uint32_t object_size;       // Payload bytes
+    uint32_t slab_bytes;        // Size of one slab taken from the block allocator
+    slab_t* partial;            // Slabs with at least one free slot
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t live;
+    uint64_t slabs;
+} slab_class_t;
+
+#define SLAB_TAG        1ULL
+#define ALIGNED_TAG     2ULL
+#define SLAB_TAG_SIZE   sizeof(uint64_t)
+#define SLAB_MAX_SIZE   2048
+
+static slab_class_t slab_classes[HEAP_SLAB_CLASSES] = {
+    { 16,   4096  }, { 32,   4096  }, { 64,   4096  }, { 128,  4096  },
+    { 256,  4096  }, { 512,  16384 }, { 1024, 16384 }, { 2048, 16384 },
+};
+
+#define HEAP_GROW_MIN   (64 * 1024)     // Map at least this much at a time, and keep it when trimming
 
 static uint64_t heap_base;
 static uint64_t heap_end;
 static uint64_t heap_size;
-static block_header_t* free_list;
+static uint64_t heap_floor;         // End of the region given to heap_init, never trimmed
+static uint64_t heap_limit;         // End of the window the heap may grow into
 static uint64_t total_allocated;
 static uint64_t allocation_count;
+static uint64_t grow_count;
+static uint64_t trimmed_pages;
+static uint64_t call_count;         // kmalloc/krealloc/kfree and friends
+static uint64_t realloc_in_place;
+static uint64_t realloc_moved;
 
-#define HEADER_SIZE sizeof(block_header_t)
-#define ALIGN(size) (((size) + 7) & ~7)  // 8-byte alignment
+// kmalloc_pages allocations, looked up by kfree
+#define LARGE_MAX 64
+
+typedef struct {
+    uint64_t addr;              // Direct map address of the frames
+    uint64_t pages;             // 0 = slot unused
+} large_object_t;
+
+static large_object_t large_objects[LARGE_MAX];
+static uint64_t large_count;
+static uint64_t large_pages;
+
+// Slab bookkeeping so the totals above can be corrected for slab pages
+static uint64_t slab_reserved_bytes;
+static uint64_t slab_page_count;
+static uint64_t slab_used_bytes;
+static uint64_t slab_object_count;
 
 void heap_init(uint64_t start, uint64_t size) {
     heap_base = start;
     heap_end = start + size;
     heap_size = size;
+    heap_floor = heap_end;
     total_allocated = 0;
     allocation_count = 0;
-    
-    // Initialize with one large free block
-    free_list = (block_header_t*)start;
-    free_list->size = size - HEADER_SIZE;
-    free_list->is_free = 1;
-    free_list->next = 0;
+    grow_count = 0;
+    trimmed_pages = 0;
+    call_count = 0;
+    realloc_in_place = 0;
+    realloc_moved = 0;
+    large_count = 0;
+    large_pages = 0;
+    for (int i = 0; i < LARGE_MAX; i++) large_objects[i].pages = 0;
+
+    // Capacity follows installed RAM, bounded by the virtual window
+    uint64_t window = get_total_memory();
+    if (window > HEAP_VIRT_SIZE) window = HEAP_VIRT_SIZE;
+    if (window < size) window = size;
+    heap_limit = start + window;
+
+    slab_reserved_bytes = 0;
+    slab_page_count = 0;
+    slab_used_bytes = 0;
+    slab_object_count = 0;
+    for (int i = 0; i < HEAP_SLAB_CLASSES; i++) {
+        slab_classes[i].partial = 0;
+        slab_classes[i].hits = 0;
+        slab_classes[i].misses = 0;
+        slab_classes[i].live = 0;
+        slab_classes[i].slabs = 0;
+    }
+
+    block_init(start, size);
 }
 
-void* kmalloc(uint64_t size) {
+// Map fresh frames behind heap_end so a block of size bytes can fit
+static int heap_grow(uint64_t size) {
+    // Leave room for block headers and TLSF rounding up to the next bin
+    uint64_t bytes = (size + (size >> 4) + 2 * PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (bytes < HEAP_GROW_MIN) bytes = HEAP_GROW_MIN;
+    if (bytes > heap_limit - heap_end) bytes = heap_limit - heap_end;
+
+    uint64_t mapped = 0;
+    while (mapped < bytes) {
+        void* frame = alloc_frame();
+        if (!frame) break;
+        if (map_page(heap_end + mapped, (uint64_t)frame, PAGE_PRESENT | PAGE_RW) != 0) {
+            free_frame(frame);
+            break;
+        }
+        mapped += PAGE_SIZE;
+    }
+    if (mapped == 0) return -1;  // Out of frames or out of window
+
+    block_grow(heap_end + mapped);
+    heap_end += mapped;
+    heap_size += mapped;
+    grow_count++;
+    return 0;
+}
+
+static void heap_copy(void* dst, const void* src, uint64_t n) {
+    uint64_t words = n / 8;
+    asm volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint64_t i = 0; i < n % 8; i++) d[i] = s[i];
+}
+
+static void heap_zero(void* dst, uint64_t n) {
+    uint64_t words = n / 8;
+    asm volatile("rep stosq" : "+D"(dst), "+c"(words) : "a"(0ULL) : "memory");
+
+    uint8_t* d = (uint8_t*)dst;
+    for (uint64_t i = 0; i < n % 8; i++) d[i] = 0;
+}
+
+static void* heap_block_alloc(uint64_t size) {
+    void* ptr = block_alloc(size);
+    if (!ptr && heap_grow(size) == 0) {
+        ptr = block_alloc(size);
+    }
+    if (ptr) {
+        total_allocated += block_footprint(ptr);
+        allocation_count++;
+    }
+    return ptr;
+}
+
+static uint64_t heap_block_free(void* ptr) {
+    uint64_t released = block_free(ptr);
+    if (released) {
+        total_allocated -= released;
+        allocation_count--;
+    }
+    return released;
+}
+
+static int slab_class_for(uint64_t size) {
+    for (int i = 0; i < HEAP_SLAB_CLASSES; i++) {
+        if (size <= slab_classes[i].object_size) return i;
+    }
+    return -1;
+}
+
+static void slab_unlink(slab_class_t* cls, slab_t* slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cls->partial = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+static void slab_link(slab_class_t* cls, slab_t* slab) {
+    slab->prev = 0;
+    slab->next = cls->partial;
+    if (cls->partial) cls->partial->prev = slab;
+    cls->partial = slab;
+}
+
+static slab_t* slab_create(int class_idx) {
+    slab_class_t* cls = &slab_classes[class_idx];
+    slab_t* slab = (slab_t*)heap_block_alloc(cls->slab_bytes);
+    if (!slab) return 0;
+
+    uint64_t slot = SLAB_TAG_SIZE + cls->object_size;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->free_objects = 0;
+    slab->class_idx = class_idx;
+    slab->in_use = 0;
+    slab->carved = 0;
+    slab->capacity = (cls->slab_bytes - ALIGN(sizeof(slab_t))) / slot;
+
+    cls->slabs++;
+    slab_page_count++;
+    slab_reserved_bytes += block_footprint(slab);
+    return slab;
+}
+
+static void slab_destroy(slab_t* slab) {
+    slab_class_t* cls = &slab_classes[slab->class_idx];
+    cls->slabs--;
+    slab_page_count--;
+    slab_reserved_bytes -= block_footprint(slab);
+    heap_block_free(slab);
+}
+
+static void* slab_alloc(int class_idx) {
+    slab_class_t* cls = &slab_classes[class_idx];
+    slab_t* slab = cls->partial;
+
+    if (slab) {
+        cls->hits++;
+    } else {
+        cls->misses++;
+        slab = slab_create(class_idx);
+        if (!slab) return 0;
+        slab_link(cls, slab);
+    }
+
+    uint64_t* payload;
+    if (slab->free_objects) {
+        payload = (uint64_t*)slab->free_objects;
+        slab->free_objects = *(void**)payload;
+    } else {
+        // Carve the next untouched slot; no up-front freelist build
+        uint64_t slot = SLAB_TAG_SIZE + cls->object_size;
+        uint64_t* tag = (uint64_t*)((uint64_t)slab + ALIGN(sizeof(slab_t)) + slab->carved * slot);
+        *tag = (uint64_t)slab | SLAB_TAG;
+        payload = tag + 1;
+        slab->carved++;
+    }
+
+    slab->in_use++;
+    if (slab->in_use == slab->capacity) {
+        slab_unlink(cls, slab);
+    }
+
+    cls->live++;
+    slab_used_bytes += SLAB_TAG_SIZE + cls->object_size;
+    slab_object_count++;
+    return payload;
+}
+
+static void slab_free(slab_t* slab, void* ptr) {
+    slab_class_t* cls = &slab_classes[slab->class_idx];
+
+    if (slab->in_use == 0) {
+        return;  // Double free protection
+    }
+
+    *(void**)ptr = slab->free_objects;
+    slab->free_objects = ptr;
+
+    if (slab->in_use == slab->capacity) {
+        slab_link(cls, slab);   // Was full, it has room again
+    }
+    slab->in_use--;
+
+    cls->live--;
+    slab_used_bytes -= SLAB_TAG_SIZE + cls->object_size;
+    slab_object_count--;
+
+    // Give empty slabs back, but keep one around so a class that
+    // bounces between 0 and 1 objects doesn't churn the block allocator
+    if (slab->in_use == 0 && (slab->prev || slab->next)) {
+        slab_unlink(cls, slab);
+        slab_destroy(slab);
+    }
+}
+
+// ===== LARGE OBJECTS =====
+
+static void* large_alloc(uint64_t pages, int zone) {
+    if (pages == 0) return 0;
+
+    int slot = -1;
+    for (int i = 0; i < LARGE_MAX; i++) {
+        if (large_objects[i].pages == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) return 0;
+
+    void* frames = alloc_frames_zone(pages, PAGE_SIZE, zone);
+    if (!frames) return 0;
+
+    // Used through the direct map, which already covers it with huge pages
+    uint64_t base = (uint64_t)phys_to_virt((uint64_t)frames);
+    large_objects[slot].addr = base;
+    large_objects[slot].pages = pages;
+    large_count++;
+    large_pages += pages;
+    return (void*)base;
+}
+
+static large_object_t* large_find(void* ptr) {
+    for (int i = 0; i < LARGE_MAX; i++) {
+        large_object_t* obj = &large_objects[i];
+        if (obj->pages && obj->addr == (uint64_t)ptr) return obj;
+    }
+    return 0;   // Not ours: invalid pointer
+}
+
+static void large_free(void* ptr) {
+    large_object_t* obj = large_find(ptr);
+    if (!obj) return;
+
+    free_frames((void*)virt_to_phys((void*)obj->addr), obj->pages);
+    large_count--;
+    large_pages -= obj->pages;
+    obj->pages = 0;
+}
+
+static void* heap_alloc(uint64_t size) {
     if (size == 0) return 0;
-    
-    size = ALIGN(size);
-    
-    block_header_t* current = free_list;
-    block_header_t* prev = 0;
-    
-    // First-fit allocation
-    while (current) {
-        if (current->is_free && current->size >= size) {
-            // Found a suitable block
-            if (current->size > size + HEADER_SIZE + 64) {
-                // Split the block if there's enough space left
-                block_header_t* new_block = (block_header_t*)((uint64_t)current + HEADER_SIZE + size);
-                new_block->size = current->size - size - HEADER_SIZE;
-                new_block->is_free = 1;
-                new_block->next = current->next;
-                
-                current->size = size;
-                current->next = new_block;
+
+    if (size <= SLAB_MAX_SIZE) {
+        void* ptr = slab_alloc(slab_class_for(size));
+        if (ptr) return ptr;
+        // No room for a new slab; the exact-size block may still fit
+    } else if (size >= HEAP_LARGE_THRESHOLD) {
+        void* ptr = large_alloc((size + PAGE_SIZE - 1) / PAGE_SIZE, ZONE_NORMAL);
+        if (ptr) return ptr;
+        // No contiguous run or no free slot; fall back to the heap
+    }
+
+    return heap_block_alloc(size);
+}
+
+static void heap_free(void* ptr) {
+    if ((uint64_t)ptr < heap_base + SLAB_TAG_SIZE || (uint64_t)ptr >= heap_end) {
+        large_free(ptr);
+        return;
+    }
+
+    uint64_t tag = *((uint64_t*)ptr - 1);
+    if (tag & SLAB_TAG) {
+        slab_free((slab_t*)(tag & ~SLAB_TAG), ptr);
+        return;
+    }
+    if (tag & ALIGNED_TAG) {
+        heap_block_free((void*)(tag & ~ALIGNED_TAG));
+        return;
+    }
+
+    heap_block_free(ptr);
+}
+
+static void* heap_realloc(void* ptr, uint64_t size) {
+    // Work out how much the caller can already use at ptr
+    uint64_t old_size;
+    if ((uint64_t)ptr < heap_base + SLAB_TAG_SIZE || (uint64_t)ptr >= heap_end) {
+        large_object_t* obj = large_find(ptr);
+        if (!obj) return 0;
+        old_size = obj->pages * PAGE_SIZE;
+    } else {
+        uint64_t tag = *((uint64_t*)ptr - 1);
+        if (tag & SLAB_TAG) {
+            old_size = slab_classes[((slab_t*)(tag & ~SLAB_TAG))->class_idx].object_size;
+        } else if (tag & ALIGNED_TAG) {
+            void* raw = (void*)(tag & ~ALIGNED_TAG);
+            old_size = block_usable(raw) - ((uint64_t)ptr - (uint64_t)raw);
+        } else {
+            // Grow or shrink the block where it is if the neighbour allows
+            uint64_t before = block_footprint(ptr);
+            if (block_resize(ptr, size)) {
+                total_allocated += block_footprint(ptr) - before;
+                realloc_in_place++;
+                return ptr;
             }
-            
-            current->is_free = 0;
-            total_allocated += current->size + HEADER_SIZE;
-            allocation_count++;
-            
-            return (void*)((uint64_t)current + HEADER_SIZE);
+            old_size = block_usable(ptr);
         }
-        
-        prev = current;
-        current = current->next;
     }
-    
-    return 0;  // Out of memory
+
+    if (size <= old_size) {
+        realloc_in_place++;
+        return ptr;
+    }
+
+    // Move; alignment from kmalloc_aligned is not carried over
+    void* new_ptr = heap_alloc(size);
+    if (!new_ptr) return 0;
+    heap_copy(new_ptr, ptr, old_size);
+    heap_free(ptr);
+    realloc_moved++;
+    return new_ptr;
+}
+
+// ===== PUBLIC ENTRY POINTS =====
+//
+// Each one counts the call and, while the profiler is on, records the
+// block against its caller's return address.
+
+void* kmalloc(uint64_t size) {
+    call_count++;
+    void* ptr = heap_alloc(size);
+    if (heap_prof_active && ptr) prof_record(ptr, size, __builtin_return_address(0));
+    return ptr;
 }
 
 void kfree(void* ptr) {
     if (!ptr) return;
-    
-    block_header_t* block = (block_header_t*)((uint64_t)ptr - HEADER_SIZE);
-    
-    // Sanity check
-    if ((uint64_t)block < heap_base || (uint64_t)block >= heap_end) {
-        return;  // Invalid pointer
-    }
-    
-    if (block->is_free) {
-        return;  // Double free protection
+    call_count++;
+    if (heap_prof_active) prof_forget(ptr);
+    heap_free(ptr);
+}
+
+void* kcalloc(uint64_t count, uint64_t size) {
+    if (size && count > ~0ULL / size) return 0;   // count * size overflows
+    call_count++;
+
+    void* ptr = heap_alloc(count * size);
+    if (ptr) {
+        heap_zero(ptr, count * size);
+        if (heap_prof_active) prof_record(ptr, count * size, __builtin_return_address(0));
     }
-    
-    block->is_free = 1;
-    total_allocated -= (block->size + HEADER_SIZE);
-    allocation_count--;
-    
-    // Coalesce with next block if it's free
-    if (block->next && block->next->is_free) {
-        block->size += HEADER_SIZE + block->next->size;
-        block->next = block->next->next;
+    return ptr;
+}
+
+void* krealloc(void* ptr, uint64_t size) {
+    call_count++;
+
+    void* new_ptr;
+    if (!ptr) {
+        new_ptr = heap_alloc(size);
+    } else if (size == 0) {
+        if (heap_prof_active) prof_forget(ptr);
+        heap_free(ptr);
+        return 0;
+    } else {
+        new_ptr = heap_realloc(ptr, size);
     }
-    
-    // Coalesce with previous block
-    block_header_t* current = free_list;
-    while (current && current->next != block) {
-        current = current->next;
+
+    if (heap_prof_active && new_ptr) {
+        if (ptr) prof_forget(ptr);
+        prof_record(new_ptr, size, __builtin_return_address(0));
     }
-    
-    if (current && current->is_free && 
-        (uint64_t)current + HEADER_SIZE + current->size == (uint64_t)block) {
-        current->size += HEADER_SIZE + block->size;
-        current->next = block->next;
+    return new_ptr;
+}
+
+void* kmalloc_aligned(uint64_t size, uint64_t align) {
+    if (size == 0 || (align & (align - 1))) return 0;
+    call_count++;
+
+    void* ptr = 0;
+    if (align <= SLAB_TAG_SIZE) {
+        ptr = heap_alloc(size);
+    } else {
+        if (size >= HEAP_LARGE_THRESHOLD && align <= PAGE_SIZE) {
+            ptr = large_alloc((size + PAGE_SIZE - 1) / PAGE_SIZE, ZONE_NORMAL);
+        }
+        if (!ptr) {
+            // Over-allocate a block and leave a tag pointing back at it
+            uint64_t raw = (uint64_t)heap_block_alloc(size + align + SLAB_TAG_SIZE);
+            if (!raw) return 0;
+
+            uint64_t aligned = (raw + SLAB_TAG_SIZE + align - 1) & ~(align - 1);
+            *((uint64_t*)aligned - 1) = raw | ALIGNED_TAG;
+            ptr = (void*)aligned;
+        }
     }
+
+    if (heap_prof_active && ptr) prof_record(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+
+void* kmalloc_pages(uint64_t pages) {
+    call_count++;
+    void* ptr = large_alloc(pages, ZONE_NORMAL);
+    if (heap_prof_active && ptr) prof_record(ptr, pages * PAGE_SIZE, __builtin_return_address(0));
+    return ptr;
+}
+
+void* kmalloc_pages_zone(uint64_t pages, int zone) {
+    call_count++;
+    void* ptr = large_alloc(pages, zone);
+    if (heap_prof_active && ptr) prof_record(ptr, pages * PAGE_SIZE, __builtin_return_address(0));
+    return ptr;
+}
+
+uint64_t kvirt_to_phys(const void* ptr) {
+    return virt_to_phys(ptr);
+}
+
+void heap_trim() {
+    // Drop the empty slab each class keeps cached; it may be pinning the top
+    for (int i = 0; i < HEAP_SLAB_CLASSES; i++) {
+        slab_t* slab = slab_classes[i].partial;
+        while (slab) {
+            slab_t* next = slab->next;
+            if (slab->in_use == 0) {
+                slab_unlink(&slab_classes[i], slab);
+                slab_destroy(slab);
+            }
+            slab = next;
+        }
+    }
+
+    // Only the free tail can go; keep HEAP_GROW_MIN of it so the next
+    // allocation burst doesn't immediately have to map pages again
+    uint64_t new_end = (block_trim_point() + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    new_end += HEAP_GROW_MIN;
+    if (new_end < heap_floor) new_end = heap_floor;
+    if (new_end >= heap_end) return;
+
+    block_shrink(new_end);
+    for (uint64_t addr = new_end; addr < heap_end; addr += PAGE_SIZE) {
+        uint64_t frame = unmap_page(addr);
+        if (frame) {
+            free_frame((void*)frame);
+            trimmed_pages++;
+        }
+    }
+    heap_size -= heap_end - new_end;
+    heap_end = new_end;
 }
 
 uint64_t heap_get_used() {
-    return total_allocated;
+    return total_allocated - slab_reserved_bytes + slab_used_bytes;
 }
 
 uint64_t heap_get_free() {
-    return heap_size - total_allocated;
+    return heap_size - heap_get_used();
 }
 
 uint64_t heap_get_total() {
@@ -120,5 +552,67 @@ uint64_t heap_get_total() {
 }
 
 uint64_t heap_get_allocations() {
-    return allocation_count;
+    return allocation_count - slab_page_count + slab_object_count;
+}
+
+int heap_get_slab_stats(int class_idx, heap_slab_stats_t* stats) {
+    if (class_idx < 0 || class_idx >= HEAP_SLAB_CLASSES || !stats) return -1;
+
+    slab_class_t* cls = &slab_classes[class_idx];
+    stats->object_size = cls->object_size;
+    stats->hits = cls->hits;
+    stats->misses = cls->misses;
+    stats->live = cls->live;
+    stats->slabs = cls->slabs;
+    return 0;
+}
+
+uint64_t heap_get_largest_free() {
+    return block_largest_free();
+}
+
+uint64_t heap_get_fragmentation() {
+    // Share of free memory that a single request cannot use, in percent
+    uint64_t free = heap_size - total_allocated;
+    if (free == 0) return 0;
+
+    uint64_t largest = block_largest_free();
+    if (largest >= free) return 0;
+    return 100 - (largest * 100) / free;
+}
+
+const char* heap_get_backend() {
+    return block_backend_name();
+}
+
+uint64_t heap_get_limit() {
+    return heap_limit - heap_base;
+}
+
+uint64_t heap_get_grows() {
+    return grow_count;
+}
+
+uint64_t heap_get_trimmed_pages() {
+    return trimmed_pages;
+}
+
+uint64_t heap_get_large_objects() {
+    return large_count;
+}
+
+uint64_t heap_get_large_pages() {
+    return large_pages;
+}
+
+uint64_t heap_get_calls() {
+    return call_count;
+}
+
+uint64_t heap_get_realloc_in_place() {
+    return realloc_in_place;
+}
+
+uint64_t heap_get_realloc_moved() {
+    return realloc_moved;
 }
\ No newline at end of file
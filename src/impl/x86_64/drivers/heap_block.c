@@ -0,0 +1,244 @@
+// heap_block.c - boundary-tag first-fit block allocator (default backend)
+#ifndef HEAP_TLSF
+
+#include "heap_internal.h"
+#include <stdint.h>
+
+// Every block carries a header and a footer (boundary tags), so both
+// neighbours of a block can be found from its address alone. Free blocks
+// additionally sit on a doubly linked free list threaded through their
+// payload, which makes kfree and coalescing constant time.
+typedef struct block_header {
+    uint64_t size;      // Payload bytes
+    uint32_t magic;     // Low word of the tag that sits right before the payload
+    uint32_t is_free;
+} block_header_t;
+
+typedef struct block_footer {
+    uint64_t size;      // Copy of the header size
+    uint64_t is_free;
+} block_footer_t;
+
+typedef struct free_node {
+    struct free_node* next;
+    struct free_node* prev;
+} free_node_t;
+
+static uint64_t heap_base;
+static uint64_t heap_end;
+static free_node_t* free_list;     // Free blocks only, most recently freed first
+
+#define HEADER_SIZE sizeof(block_header_t)
+#define FOOTER_SIZE sizeof(block_footer_t)
+#define BLOCK_OVERHEAD (HEADER_SIZE + FOOTER_SIZE)
+#define MIN_PAYLOAD sizeof(free_node_t)
+
+#define BLOCK_PAYLOAD(b)  ((void*)((uint64_t)(b) + HEADER_SIZE))
+#define BLOCK_FOOTER(b)   ((block_footer_t*)((uint64_t)(b) + HEADER_SIZE + (b)->size))
+#define PAYLOAD_BLOCK(p)  ((block_header_t*)((uint64_t)(p) - HEADER_SIZE))
+
+static void block_set(block_header_t* block, uint64_t size, int is_free) {
+    block->size = size;
+    block->magic = BLOCK_MAGIC;
+    block->is_free = is_free;
+
+    block_footer_t* footer = BLOCK_FOOTER(block);
+    footer->size = size;
+    footer->is_free = is_free;
+}
+
+static block_header_t* block_next(block_header_t* block) {
+    uint64_t next = (uint64_t)BLOCK_FOOTER(block) + FOOTER_SIZE;
+    return (next < heap_end) ? (block_header_t*)next : 0;
+}
+
+static block_header_t* block_prev(block_header_t* block) {
+    if ((uint64_t)block <= heap_base) return 0;
+
+    block_footer_t* footer = (block_footer_t*)((uint64_t)block - FOOTER_SIZE);
+    return (block_header_t*)((uint64_t)footer - footer->size - HEADER_SIZE);
+}
+
+static block_header_t* block_last(void) {
+    block_footer_t* footer = (block_footer_t*)(heap_end - FOOTER_SIZE);
+    return (block_header_t*)((uint64_t)footer - footer->size - HEADER_SIZE);
+}
+
+static void free_list_insert(block_header_t* block) {
+    free_node_t* node = (free_node_t*)BLOCK_PAYLOAD(block);
+    node->prev = 0;
+    node->next = free_list;
+    if (free_list) free_list->prev = node;
+    free_list = node;
+}
+
+static void free_list_remove(block_header_t* block) {
+    free_node_t* node = (free_node_t*)BLOCK_PAYLOAD(block);
+    if (node->prev) node->prev->next = node->next;
+    else free_list = node->next;
+    if (node->next) node->next->prev = node->prev;
+}
+
+void block_init(uint64_t start, uint64_t size) {
+    heap_base = start;
+    heap_end = start + size;
+
+    // Initialize with one large free block
+    free_list = 0;
+    block_header_t* block = (block_header_t*)start;
+    block_set(block, size - BLOCK_OVERHEAD, 1);
+    free_list_insert(block);
+}
+
+void* block_alloc(uint64_t size) {
+    size = ALIGN(size);
+    if (size < MIN_PAYLOAD) size = MIN_PAYLOAD;
+
+    // First-fit over the free blocks only
+    for (free_node_t* node = free_list; node; node = node->next) {
+        block_header_t* current = PAYLOAD_BLOCK(node);
+        if (current->size < size) continue;
+
+        free_list_remove(current);
+
+        // Split the block if there's enough space left
+        if (current->size > size + BLOCK_OVERHEAD + 64) {
+            uint64_t remaining = current->size - size - BLOCK_OVERHEAD;
+            block_set(current, size, 0);
+
+            block_header_t* new_block = block_next(current);
+            block_set(new_block, remaining, 1);
+            free_list_insert(new_block);
+        } else {
+            block_set(current, current->size, 0);
+        }
+
+        return BLOCK_PAYLOAD(current);
+    }
+
+    return 0;  // Out of memory
+}
+
+uint64_t block_free(void* ptr) {
+    block_header_t* block = PAYLOAD_BLOCK(ptr);
+
+    if (block->magic != BLOCK_MAGIC || block->is_free) {
+        return 0;  // Double free protection
+    }
+
+    uint64_t released = block->size + BLOCK_OVERHEAD;
+    uint64_t size = block->size;
+
+    // Coalesce with next block if it's free
+    block_header_t* next = block_next(block);
+    if (next && next->is_free) {
+        free_list_remove(next);
+        size += BLOCK_OVERHEAD + next->size;
+        next->magic = 0;
+    }
+
+    // Coalesce with previous block, found through its footer
+    block_header_t* prev = block_prev(block);
+    if (prev && prev->is_free) {
+        free_list_remove(prev);
+        size += BLOCK_OVERHEAD + prev->size;
+        block->magic = 0;   // Stale header inside the merged block
+        block = prev;
+    }
+
+    block_set(block, size, 1);
+    free_list_insert(block);
+    return released;
+}
+
+uint64_t block_footprint(void* ptr) {
+    return PAYLOAD_BLOCK(ptr)->size + BLOCK_OVERHEAD;
+}
+
+uint64_t block_usable(void* ptr) {
+    return PAYLOAD_BLOCK(ptr)->size;
+}
+
+int block_resize(void* ptr, uint64_t size) {
+    block_header_t* block = PAYLOAD_BLOCK(ptr);
+    size = ALIGN(size);
+    if (size < MIN_PAYLOAD) size = MIN_PAYLOAD;
+
+    uint64_t avail = block->size;
+    if (size > avail) {
+        // Growing only works by swallowing a free neighbour
+        block_header_t* next = block_next(block);
+        if (!next || !next->is_free || avail + BLOCK_OVERHEAD + next->size < size) {
+            return 0;
+        }
+        free_list_remove(next);
+        next->magic = 0;
+        avail += BLOCK_OVERHEAD + next->size;
+    }
+
+    if (avail <= size + BLOCK_OVERHEAD + 64) {
+        block_set(block, avail, 0);
+        return 1;
+    }
+
+    // Hand the tail back, merged with whatever free block follows it
+    block_set(block, size, 0);
+    block_header_t* rest = block_next(block);
+    uint64_t rest_size = avail - size - BLOCK_OVERHEAD;
+    block_set(rest, rest_size, 1);
+
+    block_header_t* after = block_next(rest);
+    if (after && after->is_free) {
+        free_list_remove(after);
+        after->magic = 0;
+        block_set(rest, rest_size + BLOCK_OVERHEAD + after->size, 1);
+    }
+    free_list_insert(rest);
+    return 1;
+}
+
+uint64_t block_largest_free(void) {
+    uint64_t largest = 0;
+    for (free_node_t* node = free_list; node; node = node->next) {
+        uint64_t size = PAYLOAD_BLOCK(node)->size;
+        if (size > largest) largest = size;
+    }
+    return largest;
+}
+
+void block_grow(uint64_t new_end) {
+    block_header_t* last = block_last();
+    uint64_t old_end = heap_end;
+    heap_end = new_end;
+
+    // Extend a free tail in place, otherwise start a new block
+    if (last->is_free) {
+        free_list_remove(last);
+        block_set(last, last->size + (new_end - old_end), 1);
+        free_list_insert(last);
+    } else {
+        block_header_t* block = (block_header_t*)old_end;
+        block_set(block, new_end - old_end - BLOCK_OVERHEAD, 1);
+        free_list_insert(block);
+    }
+}
+
+uint64_t block_trim_point(void) {
+    block_header_t* last = block_last();
+    if (!last->is_free) return heap_end;
+    return (uint64_t)BLOCK_PAYLOAD(last) + MIN_PAYLOAD + FOOTER_SIZE;
+}
+
+void block_shrink(uint64_t new_end) {
+    block_header_t* last = block_last();
+    free_list_remove(last);
+    heap_end = new_end;
+    block_set(last, new_end - (uint64_t)last - BLOCK_OVERHEAD, 1);
+    free_list_insert(last);
+}
+
+const char* block_backend_name(void) {
+    return "boundary-tag first-fit";
+}
+
+#endif
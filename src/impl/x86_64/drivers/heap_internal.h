@@ -0,0 +1,32 @@
+// heap_internal.h - interface between the kmalloc front-end and the block backend
+#ifndef HEAP_INTERNAL_H
+#define HEAP_INTERNAL_H
+
+#include <stdint.h>
+
+// Both backends place BLOCK_MAGIC (bits 0 and 1 clear) in the word right
+// before each payload; slab objects and aligned allocations put a tag with
+// one of those bits set there instead (see heap.c).
+#define BLOCK_MAGIC 0x4B4C4230  // "0BLK"
+
+#define ALIGN(size) (((size) + 7) & ~7)  // 8-byte alignment
+
+// Implemented by heap_block.c (default) or heap_tlsf.c (HEAP_TLSF)
+void block_init(uint64_t start, uint64_t size);
+void* block_alloc(uint64_t size);
+uint64_t block_free(void* ptr);             // Returns bytes released, 0 if rejected
+uint64_t block_footprint(void* ptr);        // Payload plus per-block overhead
+uint64_t block_usable(void* ptr);           // Payload bytes the caller may use
+int block_resize(void* ptr, uint64_t size); // In place, 1 on success
+uint64_t block_largest_free(void);
+void block_grow(uint64_t new_end);          // Arena now extends to new_end
+uint64_t block_trim_point(void);            // Lowest end the arena can shrink to
+void block_shrink(uint64_t new_end);        // Give up everything past new_end
+const char* block_backend_name(void);
+
+// Allocation profiler (heap_prof.c); heap.c only calls in while it is on
+extern int heap_prof_active;
+void prof_record(void* ptr, uint64_t size, void* site);
+void prof_forget(void* ptr);
+
+#endif
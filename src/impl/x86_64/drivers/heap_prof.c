@@ -0,0 +1,181 @@
+// heap_prof.c - allocation-site profiler for kmalloc and friends
+//
+// Live blocks are kept in an open-addressing table keyed by pointer, which
+// is only allocated while profiling is on. When it is off the allocator
+// pays one predictable branch per call.
+#include "drivers/heap.h"
+#include "drivers/memory.h"
+#include "heap_internal.h"
+#include <stdint.h>
+
+#define PROF_RECORDS_LOG2 12
+#define PROF_RECORDS    (1 << PROF_RECORDS_LOG2)
+#define PROF_MAX_LIVE   (PROF_RECORDS * 3 / 4)  // Keep probes short
+#define PROF_MAX_SITES  256
+
+typedef struct {
+    uint64_t ptr;       // 0 = empty slot
+    uint64_t size;
+    void* site;
+    const char* tag;
+} prof_record_t;
+
+int heap_prof_active;
+
+static prof_record_t* records;
+static heap_prof_site_t* sites;     // Scratch space for grouping, same allocation
+static uint64_t table_pages;
+static uint64_t live_records;
+static uint64_t dropped;
+static const char* current_tag = "kernel";
+
+static uint64_t prof_hash(uint64_t ptr) {
+    return ((ptr >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - PROF_RECORDS_LOG2);
+}
+
+int heap_prof_enable(int on) {
+    if (on && !heap_prof_active) {
+        uint64_t bytes = PROF_RECORDS * sizeof(prof_record_t) + PROF_MAX_SITES * sizeof(heap_prof_site_t);
+        table_pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+        records = (prof_record_t*)kmalloc_pages(table_pages);
+        if (!records) return -1;
+
+        sites = (heap_prof_site_t*)(records + PROF_RECORDS);
+        for (int i = 0; i < PROF_RECORDS; i++) records[i].ptr = 0;
+        live_records = 0;
+        dropped = 0;
+        heap_prof_active = 1;
+    } else if (!on && heap_prof_active) {
+        heap_prof_active = 0;
+        kfree(records);
+        records = 0;
+        sites = 0;
+    }
+    return 0;
+}
+
+int heap_prof_enabled() {
+    return heap_prof_active;
+}
+
+const char* heap_prof_set_tag(const char* tag) {
+    const char* prev = current_tag;
+    current_tag = tag ? tag : "kernel";
+    return prev;
+}
+
+void prof_record(void* ptr, uint64_t size, void* site) {
+    if (live_records >= PROF_MAX_LIVE) {
+        dropped++;
+        return;
+    }
+
+    uint64_t i = prof_hash((uint64_t)ptr);
+    while (records[i].ptr && records[i].ptr != (uint64_t)ptr) {
+        i = (i + 1) & (PROF_RECORDS - 1);
+    }
+    if (!records[i].ptr) live_records++;
+
+    records[i].ptr = (uint64_t)ptr;
+    records[i].size = size;
+    records[i].site = site;
+    records[i].tag = current_tag;
+}
+
+void prof_forget(void* ptr) {
+    uint64_t i = prof_hash((uint64_t)ptr);
+    while (records[i].ptr != (uint64_t)ptr) {
+        if (!records[i].ptr) return;    // Made before profiling started
+        i = (i + 1) & (PROF_RECORDS - 1);
+    }
+    live_records--;
+
+    // Backward-shift deletion keeps every probe chain unbroken
+    uint64_t j = i;
+    while (1) {
+        j = (j + 1) & (PROF_RECORDS - 1);
+        if (!records[j].ptr) break;
+
+        uint64_t home = prof_hash(records[j].ptr);
+        int movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            records[i] = records[j];
+            i = j;
+        }
+    }
+    records[i].ptr = 0;
+}
+
+// Collapse live records into sites (by_tag = 0) or tags (by_tag = 1)
+static int group_records(int by_tag) {
+    int count = 0;
+    for (int i = 0; i < PROF_RECORDS; i++) {
+        prof_record_t* r = &records[i];
+        if (!r->ptr) continue;
+
+        void* site = by_tag ? 0 : r->site;
+        int g = 0;
+        while (g < count && !(sites[g].site == site && sites[g].tag == r->tag)) g++;
+        if (g == count) {
+            if (count == PROF_MAX_SITES) continue;
+            sites[g].site = site;
+            sites[g].tag = r->tag;
+            sites[g].bytes = 0;
+            sites[g].count = 0;
+            count++;
+        }
+        sites[g].bytes += r->size;
+        sites[g].count++;
+    }
+    return count;
+}
+
+// Partial selection sort: the top max groups end up first
+static int take_top(heap_prof_site_t* out, int max, int count, int sort) {
+    if (max > count) max = count;
+    for (int i = 0; i < max; i++) {
+        int best = i;
+        for (int j = i + 1; j < count; j++) {
+            uint64_t a = (sort == HEAP_PROF_SORT_COUNT) ? sites[j].count : sites[j].bytes;
+            uint64_t b = (sort == HEAP_PROF_SORT_COUNT) ? sites[best].count : sites[best].bytes;
+            if (a > b) best = j;
+        }
+        heap_prof_site_t tmp = sites[i];
+        sites[i] = sites[best];
+        sites[best] = tmp;
+        out[i] = sites[i];
+    }
+    return max;
+}
+
+int heap_prof_top_sites(heap_prof_site_t* out, int max, int sort) {
+    if (!heap_prof_active || !out) return 0;
+    return take_top(out, max, group_records(0), sort);
+}
+
+int heap_prof_top_tags(heap_prof_site_t* out, int max) {
+    if (!heap_prof_active || !out) return 0;
+    return take_top(out, max, group_records(1), HEAP_PROF_SORT_BYTES);
+}
+
+void heap_prof_histogram(uint64_t* counts, uint64_t* bytes) {
+    for (int b = 0; b < HEAP_PROF_HIST_BUCKETS; b++) {
+        counts[b] = 0;
+        bytes[b] = 0;
+    }
+    if (!heap_prof_active) return;
+
+    for (int i = 0; i < PROF_RECORDS; i++) {
+        if (!records[i].ptr) continue;
+
+        uint64_t size = records[i].size;
+        int b = 0;
+        while (b < HEAP_PROF_HIST_BUCKETS - 1 && size > (16ULL << b)) b++;
+        counts[b]++;
+        bytes[b] += size;
+    }
+}
+
+uint64_t heap_prof_dropped() {
+    return dropped;
+}
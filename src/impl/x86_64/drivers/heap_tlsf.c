@@ -0,0 +1,303 @@
+// heap_tlsf.c - Two-Level Segregated Fit block allocator (HEAP=tlsf)
+//
+// Free blocks are binned by size into FL_INDEX_COUNT power-of-two ranges,
+// each split into SL_INDEX_COUNT linear sub-ranges. A bitmap per level marks
+// the non-empty bins, so finding a fitting block is two find-first-set
+// instructions and kmalloc/kfree run in bounded time regardless of how
+// fragmented the heap is.
+#ifdef HEAP_TLSF
+
+#include "heap_internal.h"
+#include <stdint.h>
+
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT      (1 << SL_INDEX_COUNT_LOG2)
+#define ALIGN_SIZE_LOG2     3
+#define FL_INDEX_MAX        32      // Blocks up to 4 GB
+#define FL_INDEX_SHIFT      (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT      (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE    (1 << FL_INDEX_SHIFT)
+
+typedef struct tlsf_block {
+    struct tlsf_block* prev_phys;   // Physically preceding block, 0 for the first
+    uint64_t size;                  // Payload bytes
+    uint32_t magic;                 // Low word of the tag right before the payload
+    uint32_t is_free;
+} tlsf_block_t;
+
+typedef struct free_node {
+    struct tlsf_block* next;
+    struct tlsf_block* prev;
+} free_node_t;
+
+#define HEADER_SIZE sizeof(tlsf_block_t)
+#define MIN_PAYLOAD sizeof(free_node_t)
+
+#define BLOCK_PAYLOAD(b)  ((void*)((uint64_t)(b) + HEADER_SIZE))
+#define PAYLOAD_BLOCK(p)  ((tlsf_block_t*)((uint64_t)(p) - HEADER_SIZE))
+#define BLOCK_NODE(b)     ((free_node_t*)BLOCK_PAYLOAD(b))
+
+static uint64_t heap_end;
+static tlsf_block_t* last_block;    // Physically last block, the one grow/shrink resize
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[FL_INDEX_COUNT];
+static tlsf_block_t* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+static int fls64(uint64_t x) {
+    return x ? 63 - __builtin_clzll(x) : -1;
+}
+
+static int ffs32(uint32_t x) {
+    return x ? __builtin_ctz(x) : -1;
+}
+
+static void mapping_insert(uint64_t size, int* fl, int* sl) {
+    if (size < SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    } else {
+        int f = fls64(size);
+        *sl = (int)(size >> (f - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        *fl = f - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+// Round the request up to the next bin so any block found there fits
+static void mapping_search(uint64_t size, int* fl, int* sl) {
+    if (size >= SMALL_BLOCK_SIZE) {
+        size += (1ULL << (fls64(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static tlsf_block_t* block_next_phys(tlsf_block_t* block) {
+    uint64_t next = (uint64_t)BLOCK_PAYLOAD(block) + block->size;
+    return (next < heap_end) ? (tlsf_block_t*)next : 0;
+}
+
+static void free_insert(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block->size, &fl, &sl);
+
+    tlsf_block_t* head = blocks[fl][sl];
+    BLOCK_NODE(block)->next = head;
+    BLOCK_NODE(block)->prev = 0;
+    if (head) BLOCK_NODE(head)->prev = block;
+    blocks[fl][sl] = block;
+
+    fl_bitmap |= 1U << fl;
+    sl_bitmap[fl] |= 1U << sl;
+    block->is_free = 1;
+}
+
+static void free_remove(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block->size, &fl, &sl);
+
+    free_node_t* node = BLOCK_NODE(block);
+    if (node->prev) BLOCK_NODE(node->prev)->next = node->next;
+    else blocks[fl][sl] = node->next;
+    if (node->next) BLOCK_NODE(node->next)->prev = node->prev;
+
+    if (!blocks[fl][sl]) {
+        sl_bitmap[fl] &= ~(1U << sl);
+        if (!sl_bitmap[fl]) fl_bitmap &= ~(1U << fl);
+    }
+    block->is_free = 0;
+}
+
+static tlsf_block_t* find_suitable(int fl, int sl) {
+    uint32_t sl_map = sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map) {
+        // Nothing in this range; take the smallest larger first-level range
+        uint32_t fl_map = (fl + 1 < 32) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (!fl_map) return 0;
+        fl = ffs32(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    return blocks[fl][ffs32(sl_map)];
+}
+
+void block_init(uint64_t start, uint64_t size) {
+    heap_end = start + size;
+    fl_bitmap = 0;
+    for (int i = 0; i < FL_INDEX_COUNT; i++) {
+        sl_bitmap[i] = 0;
+        for (int j = 0; j < SL_INDEX_COUNT; j++) blocks[i][j] = 0;
+    }
+
+    tlsf_block_t* block = (tlsf_block_t*)start;
+    block->prev_phys = 0;
+    block->size = (size - HEADER_SIZE) & ~7ULL;
+    block->magic = BLOCK_MAGIC;
+    free_insert(block);
+    last_block = block;
+}
+
+void* block_alloc(uint64_t size) {
+    size = ALIGN(size);
+    if (size < MIN_PAYLOAD) size = MIN_PAYLOAD;
+
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT) return 0;
+
+    tlsf_block_t* block = find_suitable(fl, sl);
+    if (!block) return 0;  // Out of memory
+
+    free_remove(block);
+
+    // Split the block if there's enough space left
+    if (block->size >= size + HEADER_SIZE + MIN_PAYLOAD) {
+        tlsf_block_t* rest = (tlsf_block_t*)((uint64_t)BLOCK_PAYLOAD(block) + size);
+        rest->prev_phys = block;
+        rest->size = block->size - size - HEADER_SIZE;
+        rest->magic = BLOCK_MAGIC;
+        block->size = size;
+
+        tlsf_block_t* after = block_next_phys(rest);
+        if (after) after->prev_phys = rest;
+        else last_block = rest;
+        free_insert(rest);
+    }
+
+    return BLOCK_PAYLOAD(block);
+}
+
+uint64_t block_free(void* ptr) {
+    tlsf_block_t* block = PAYLOAD_BLOCK(ptr);
+
+    if (block->magic != BLOCK_MAGIC || block->is_free) {
+        return 0;  // Double free protection
+    }
+
+    uint64_t released = block->size + HEADER_SIZE;
+
+    // Coalesce with next block if it's free
+    tlsf_block_t* next = block_next_phys(block);
+    if (next && next->is_free) {
+        free_remove(next);
+        block->size += HEADER_SIZE + next->size;
+        next->magic = 0;
+        if (next == last_block) last_block = block;
+    }
+
+    // Coalesce with previous block
+    tlsf_block_t* prev = block->prev_phys;
+    if (prev && prev->is_free) {
+        free_remove(prev);
+        prev->size += HEADER_SIZE + block->size;
+        block->magic = 0;   // Stale header inside the merged block
+        if (block == last_block) last_block = prev;
+        block = prev;
+    }
+
+    next = block_next_phys(block);
+    if (next) next->prev_phys = block;
+
+    free_insert(block);
+    return released;
+}
+
+uint64_t block_footprint(void* ptr) {
+    return PAYLOAD_BLOCK(ptr)->size + HEADER_SIZE;
+}
+
+uint64_t block_usable(void* ptr) {
+    return PAYLOAD_BLOCK(ptr)->size;
+}
+
+int block_resize(void* ptr, uint64_t size) {
+    tlsf_block_t* block = PAYLOAD_BLOCK(ptr);
+    size = ALIGN(size);
+    if (size < MIN_PAYLOAD) size = MIN_PAYLOAD;
+
+    if (size > block->size) {
+        // Growing only works by swallowing a free neighbour
+        tlsf_block_t* next = block_next_phys(block);
+        if (!next || !next->is_free || block->size + HEADER_SIZE + next->size < size) {
+            return 0;
+        }
+        free_remove(next);
+        block->size += HEADER_SIZE + next->size;
+        next->magic = 0;
+        if (next == last_block) last_block = block;
+
+        tlsf_block_t* after = block_next_phys(block);
+        if (after) after->prev_phys = block;
+    }
+
+    if (block->size < size + HEADER_SIZE + MIN_PAYLOAD) return 1;
+
+    // Hand the tail back, merged with whatever free block follows it
+    tlsf_block_t* rest = (tlsf_block_t*)((uint64_t)BLOCK_PAYLOAD(block) + size);
+    rest->prev_phys = block;
+    rest->size = block->size - size - HEADER_SIZE;
+    rest->magic = BLOCK_MAGIC;
+    block->size = size;
+    if (block == last_block) last_block = rest;
+
+    tlsf_block_t* after = block_next_phys(rest);
+    if (after && after->is_free) {
+        free_remove(after);
+        rest->size += HEADER_SIZE + after->size;
+        after->magic = 0;
+        if (after == last_block) last_block = rest;
+        after = block_next_phys(rest);
+    }
+    if (after) after->prev_phys = rest;
+
+    free_insert(rest);
+    return 1;
+}
+
+uint64_t block_largest_free(void) {
+    if (!fl_bitmap) return 0;
+
+    // Only the highest non-empty bin can hold the largest block
+    int fl = 31 - __builtin_clz(fl_bitmap);
+    int sl = 31 - __builtin_clz(sl_bitmap[fl]);
+
+    uint64_t largest = 0;
+    for (tlsf_block_t* b = blocks[fl][sl]; b; b = BLOCK_NODE(b)->next) {
+        if (b->size > largest) largest = b->size;
+    }
+    return largest;
+}
+
+void block_grow(uint64_t new_end) {
+    uint64_t old_end = heap_end;
+    heap_end = new_end;
+
+    // Extend a free tail in place, otherwise start a new block
+    if (last_block->is_free) {
+        free_remove(last_block);
+        last_block->size += new_end - old_end;
+        free_insert(last_block);
+    } else {
+        tlsf_block_t* block = (tlsf_block_t*)old_end;
+        block->prev_phys = last_block;
+        block->size = new_end - old_end - HEADER_SIZE;
+        block->magic = BLOCK_MAGIC;
+        free_insert(block);
+        last_block = block;
+    }
+}
+
+uint64_t block_trim_point(void) {
+    if (!last_block->is_free) return heap_end;
+    return (uint64_t)BLOCK_PAYLOAD(last_block) + MIN_PAYLOAD;
+}
+
+void block_shrink(uint64_t new_end) {
+    free_remove(last_block);
+    heap_end = new_end;
+    last_block->size = new_end - (uint64_t)BLOCK_PAYLOAD(last_block);
+    free_insert(last_block);
+}
+
+const char* block_backend_name(void) {
+    return "TLSF";
+}
+
+#endif
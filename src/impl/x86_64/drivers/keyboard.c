@@ -2,6 +2,8 @@
 #include "lib/print.h"
 #include "../lib/ports.h"
 #include "lib/string.h"
+#include "sys/idle.h"
+#include "core/irq.h"
 
 #define KEYBOARD_DATA_PORT 0x60
 #define HISTORY_SIZE 20
@@ -122,16 +124,14 @@ void keyboard_handler() {
     key_buffer[buffer_index] = '\0';
 }
 
-void enable_irq(uint8_t irq) {
-    if (irq < 8)
-        outb(0x21, inb(0x21) & ~(1 << irq));
-    else
-        outb(0xA1, inb(0xA1) & ~(1 << (irq - 8)));
+static int keyboard_irq(void* ctx) {
+    keyboard_handler();
+    return IRQ_HANDLED;
 }
 
 void init_keyboard() {
     print_str("Keyboard initialized\n");
-    enable_irq(1);
+    irq_register(1, keyboard_irq, 0);
 }
 
 int get_char() {
@@ -205,7 +205,7 @@ void get_line(char* buffer, size_t max_len) {
     while (1) {
         int c = get_char();
         if (!c) {
-            __asm__ volatile("hlt");
+            cpu_idle();
             continue;
         }
 
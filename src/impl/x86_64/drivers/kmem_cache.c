@@ -0,0 +1,157 @@
+// kmem_cache.c
+#include "drivers/kmem_cache.h"
+#include "drivers/heap.h"
+#include <stdint.h>
+
+#define KMEM_SLAB_BYTES  16384  // Aim for backing allocations about this big
+#define KMEM_MIN_OBJECTS 4      // ...but with at least this many objects
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+typedef struct kmem_slab {
+    struct kmem_slab* next;
+} kmem_slab_t;
+
+struct kmem_cache {
+    const char* name;           // 0 = slot unused
+    uint64_t object_size;       // Rounded up to align
+    uint64_t align;
+    kmem_ctor_t ctor;
+    uint64_t per_slab;
+
+    kmem_slab_t* slabs;
+    void** free_stack;          // Constructed objects ready to hand out
+    uint64_t free_count;
+    uint64_t total_objects;     // Capacity of free_stack
+
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t slab_count;
+    uint64_t ctor_calls;
+};
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+
+kmem_cache_t* kmem_cache_create(const char* name, uint64_t size, uint64_t align, kmem_ctor_t ctor) {
+    if (size == 0) return 0;
+    if (align < 8) align = 8;
+    if (align & (align - 1)) return 0;
+
+    kmem_cache_t* cache = 0;
+    for (int i = 0; i < KMEM_MAX_CACHES; i++) {
+        if (!caches[i].name) {
+            cache = &caches[i];
+            break;
+        }
+    }
+    if (!cache) return 0;
+
+    cache->name = name ? name : "unnamed";
+    cache->object_size = ALIGN_UP(size, align);
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->per_slab = KMEM_SLAB_BYTES / cache->object_size;
+    if (cache->per_slab < KMEM_MIN_OBJECTS) cache->per_slab = KMEM_MIN_OBJECTS;
+
+    cache->slabs = 0;
+    cache->free_stack = 0;
+    cache->free_count = 0;
+    cache->total_objects = 0;
+    cache->allocs = 0;
+    cache->frees = 0;
+    cache->slab_count = 0;
+    cache->ctor_calls = 0;
+    return cache;
+}
+
+// Take one more slab from the heap and construct all of its objects
+static int cache_grow(kmem_cache_t* cache) {
+    const char* prev_tag = heap_prof_set_tag(cache->name);
+
+    uint64_t header = ALIGN_UP(sizeof(kmem_slab_t), cache->align);
+    kmem_slab_t* slab = (kmem_slab_t*)kmalloc_aligned(header + cache->per_slab * cache->object_size,
+                                                      cache->align);
+    void** stack = slab ? (void**)krealloc(cache->free_stack,
+                                           (cache->total_objects + cache->per_slab) * sizeof(void*)) : 0;
+    heap_prof_set_tag(prev_tag);
+
+    if (!stack) {
+        kfree(slab);
+        return -1;
+    }
+    cache->free_stack = stack;
+    cache->total_objects += cache->per_slab;
+
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+    cache->slab_count++;
+
+    uint8_t* obj = (uint8_t*)slab + header;
+    for (uint64_t i = 0; i < cache->per_slab; i++, obj += cache->object_size) {
+        if (cache->ctor) {
+            cache->ctor(obj);
+            cache->ctor_calls++;
+        }
+        cache->free_stack[cache->free_count++] = obj;
+    }
+    return 0;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (!cache) return 0;
+
+    if (cache->free_count == 0 && cache_grow(cache) != 0) {
+        return 0;  // Out of memory
+    }
+
+    cache->allocs++;
+    return cache->free_stack[--cache->free_count];
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!cache || !obj) return;
+
+    if (cache->free_count >= cache->total_objects) {
+        return;  // More frees than objects: double free
+    }
+
+    cache->free_stack[cache->free_count++] = obj;
+    cache->frees++;
+}
+
+int kmem_cache_reserve(kmem_cache_t* cache, uint64_t count) {
+    if (!cache) return -1;
+
+    while (cache->free_count < count) {
+        if (cache_grow(cache) != 0) return -1;
+    }
+    return 0;
+}
+
+void kmem_cache_destroy(kmem_cache_t* cache) {
+    if (!cache || !cache->name) return;
+
+    kmem_slab_t* slab = cache->slabs;
+    while (slab) {
+        kmem_slab_t* next = slab->next;
+        kfree(slab);
+        slab = next;
+    }
+    kfree(cache->free_stack);
+    cache->name = 0;
+}
+
+int kmem_cache_get_stats(int idx, kmem_cache_stats_t* stats) {
+    if (idx < 0 || idx >= KMEM_MAX_CACHES || !stats || !caches[idx].name) return -1;
+
+    kmem_cache_t* cache = &caches[idx];
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->allocs = cache->allocs;
+    stats->frees = cache->frees;
+    stats->live = cache->total_objects - cache->free_count;
+    stats->free_objects = cache->free_count;
+    stats->slabs = cache->slab_count;
+    stats->ctor_calls = cache->ctor_calls;
+    return 0;
+}
@@ -1,9 +1,73 @@
 #include "drivers/memory.h"
+#include "drivers/paging.h"
+#include "core/multiboot2.h"
 
-#define MAX_PHYS_PAGES 65536 // Example: 256 MB RAM (adjust later)
+#define MAX_PHYS_MEMORY DIRECT_MAP_SIZE // RAM above this is ignored
+#define MAX_REGIONS 64
 
-static uint64_t memory_bitmap[MAX_PHYS_PAGES / 64]; // 64 pages per uint64_t
-static uint64_t total_pages = 0;
+// The boot page tables direct map only the first 1 GB; the allocator
+// bitmaps are written before paging_init, so they have to be placed below it
+#define BOOT_MAPPED_LIMIT (1ULL << 30)
+
+// Used when the loader gives no memory information at all
+#define FALLBACK_MEMORY_KB (512 * 1024)
+
+// Kernel image and initial heap (0x200000)
+#define RESERVED_LOW_MEMORY (3 * 1024 * 1024)
+
+typedef struct {
+    uint64_t first;     // Page numbers, end exclusive
+    uint64_t end;
+} page_range_t;
+
+// Available RAM from the multiboot2 memory map
+static page_range_t regions[MAX_REGIONS];
+static int region_count = 0;
+
+// Ranges inside available RAM that are never handed out
+static page_range_t excluded[3];
+static int excluded_count = 0;
+
+// Binary buddy allocator. Order k blocks are 2^k pages, aligned to their
+// size. Each order has a bitmap with one bit per possible block, set while
+// that block is free and not merged into a larger one. Physical memory is
+// not mapped, so the free "lists" are these bitmaps, searched 64 blocks per
+// word, with a count per order to skip empty ones. The bitmaps (about two
+// bits per page) are sized and placed in RAM by memory_init.
+static uint64_t* buddy_bitmap;
+static uint64_t bitmap_pages = 0;
+static uint64_t* order_map[MEMORY_ORDERS];
+static uint64_t order_words[MEMORY_ORDERS];
+
+static uint64_t total_pages = 0;    // Highest usable page + 1
+static uint64_t usable_pages = 0;   // Available RAM, holes not counted
+static uint64_t free_pages = 0;
+
+// Zone boundaries are powers of two, so aligned blocks never straddle one
+// as long as merging stops at the boundary
+#define ZONE_DMA_END   ((16ULL << 20) / PAGE_SIZE)
+#define ZONE_DMA32_END ((4ULL << 30) / PAGE_SIZE)
+
+typedef struct {
+    const char* name;
+    uint64_t first;         // Page range, end exclusive
+    uint64_t end;
+    uint64_t present;       // Available pages inside the range
+    uint64_t free;
+    uint64_t watermark;     // Free pages kept back from fallback allocations
+    uint64_t fallbacks;     // Allocations served here for a higher zone
+    uint64_t order_free[MEMORY_ORDERS];
+    // Per order, no free block of this zone lies below this index. Searches
+    // start there, so the filled low end is not rescanned and the lowest
+    // block still wins.
+    uint64_t order_hint[MEMORY_ORDERS];
+} zone_t;
+
+static zone_t zones[MEMORY_ZONES] = {
+    { .name = "DMA" },
+    { .name = "DMA32" },
+    { .name = "Normal" },
+};
 
 void* memset(void* ptr, int value, uint64_t num) {
     uint8_t* p = (uint8_t*)ptr;
@@ -13,41 +77,421 @@ void* memset(void* ptr, int value, uint64_t num) {
     return ptr;
 }
 
-void memory_init(uint64_t mem_upper) {
-    // mem_upper = memory in KB reported by BIOS
-    total_pages = (mem_upper * 1024) / PAGE_SIZE;
+static inline zone_t* zone_of(uint64_t page) {
+    if (page < ZONE_DMA_END) return &zones[ZONE_DMA];
+    if (page < ZONE_DMA32_END) return &zones[ZONE_DMA32];
+    return &zones[ZONE_NORMAL];
+}
 
-    // Clear bitmap (all free)
-    memset((void*)memory_bitmap, 0, sizeof(memory_bitmap));
+static inline int block_is_free(int order, uint64_t index) {
+    return (order_map[order][index / 64] >> (index % 64)) & 1;
+}
 
-    // Mark first few pages as used (kernel + bitmap)
-    // Suppose kernel is loaded at 1 MB, bitmap occupies 64 KB
-    uint64_t used_pages = (1024 + sizeof(memory_bitmap)) / PAGE_SIZE;
-    for (uint64_t i = 0; i < used_pages; i++) {
-        memory_bitmap[i / 64] |= (1ULL << (i % 64));
+static inline void block_set(int order, uint64_t index) {
+    zone_t* z = zone_of(index << order);
+    order_map[order][index / 64] |= (1ULL << (index % 64));
+    z->order_free[order]++;
+    z->free += 1ULL << order;
+    if (index < z->order_hint[order]) z->order_hint[order] = index;
+}
+
+static inline void block_clear(int order, uint64_t index) {
+    zone_t* z = zone_of(index << order);
+    order_map[order][index / 64] &= ~(1ULL << (index % 64));
+    z->order_free[order]--;
+    z->free -= 1ULL << order;
+}
+
+// Lowest free block of an order inside a zone, -1 if there is none. The
+// scan stays between the zone's first and last block of that order, so a
+// count out of step with the bitmap cannot run it off the end.
+static int64_t block_find(zone_t* z, int order) {
+    uint64_t* map = order_map[order];
+    uint64_t index = z->order_hint[order];
+    uint64_t lowest = (z->first + (1ULL << order) - 1) >> order;
+    uint64_t end = z->end >> order;
+    if (index < lowest) index = lowest;
+
+    while (index < end) {
+        uint64_t bits = map[index / 64] >> (index % 64);
+        if (end - index < 64) bits &= (1ULL << (end - index)) - 1;
+        if (bits) {
+            index += __builtin_ctzll(bits);
+            z->order_hint[order] = index;
+            return (int64_t)index;
+        }
+        index = (index | 63) + 1;
     }
+    return -1;
 }
 
-void* alloc_frame() {
-    for (uint64_t i = 0; i < total_pages; i++) {
-        uint64_t idx = i / 64;
-        uint64_t bit = i % 64;
-        if ((memory_bitmap[idx] & (1ULL << bit)) == 0) {
-            memory_bitmap[idx] |= (1ULL << bit);
-            return (void*)(i * PAGE_SIZE);
+// Some page of the aligned 2^order block is covered by a free block: one
+// of its own size or larger containing it, or a smaller one inside it
+static int block_has_free(uint64_t page, int order) {
+    for (int k = 0; k < MEMORY_ORDERS; k++) {
+        uint64_t index = page >> k;
+        uint64_t end = index + (k < order ? 1ULL << (order - k) : 1);
+        if (end > (total_pages >> k)) end = total_pages >> k;
+
+        while (index < end) {
+            uint64_t bits = order_map[k][index / 64] >> (index % 64);
+            if (end - index < 64) bits &= (1ULL << (end - index)) - 1;
+            if (bits) return 1;
+            index = (index | 63) + 1;
         }
     }
     return 0;
 }
 
+// Block of 2^order pages starting at page stays inside one zone
+static inline int block_in_zone(uint64_t page, int order) {
+    return zone_of(page) == zone_of(page + (1ULL << order) - 1);
+}
+
+// Take a free block of exactly this order from one zone, splitting a larger
+// one if needed
+static int64_t zone_alloc(zone_t* z, int order) {
+    int k = order;
+    while (k < MEMORY_ORDERS && z->order_free[k] == 0) k++;
+    if (k == MEMORY_ORDERS) return -1;
+
+    int64_t found = block_find(z, k);
+    if (found < 0) return -1;
+    uint64_t index = (uint64_t)found;
+    block_clear(k, index);
+
+    // Split down, keeping the low half and freeing the high one
+    while (k > order) {
+        k--;
+        index <<= 1;
+        block_set(k, index + 1);
+    }
+
+    free_pages -= 1ULL << order;
+    return (int64_t)(index << order);
+}
+
+// Try the requested zone, then fall back towards DMA. A lower zone only
+// lends pages above its watermark, so general allocations on a small guest
+// cannot use up the memory only it can provide.
+static int64_t block_alloc(int order, int zone) {
+    for (int z = zone; z >= 0; z--) {
+        zone_t* candidate = &zones[z];
+        if (z != zone && candidate->free < candidate->watermark + (1ULL << order)) continue;
+
+        int64_t page = zone_alloc(candidate, order);
+        if (page >= 0) {
+            if (z != zone) candidate->fallbacks++;
+            return page;
+        }
+    }
+    return -1;
+}
+
+// Return a block and merge it with its buddy for as long as that is free
+static void block_free(uint64_t page, int order) {
+    free_pages += 1ULL << order;
+
+    uint64_t index = page >> order;
+    while (order < MEMORY_ORDERS - 1 && block_in_zone((index & ~1ULL) << order, order + 1)) {
+        uint64_t buddy = index ^ 1;
+        if (((buddy + 1) << order) > total_pages || !block_is_free(order, buddy)) break;
+        block_clear(order, buddy);
+        index >>= 1;
+        order++;
+    }
+    block_set(order, index);
+}
+
+// Free [first, first + count) as the largest aligned blocks that fit
+static void free_range(uint64_t first, uint64_t count) {
+    uint64_t page = first;
+    uint64_t end = first + count;
+    while (page < end) {
+        int order = 0;
+        while (order < MEMORY_ORDERS - 1 &&
+               (page & ((2ULL << order) - 1)) == 0 &&
+               page + (2ULL << order) <= end &&
+               block_in_zone(page, order + 1)) {
+            order++;
+        }
+        // Pages that are free already are not freed twice: a block holding
+        // any is split until they stand alone, and those are skipped
+        while (order > 0 && block_has_free(page, order)) order--;
+        if (!block_has_free(page, order)) block_free(page, order);
+        page += 1ULL << order;
+    }
+}
+
+static int order_for(uint64_t pages) {
+    int order = 0;
+    while ((1ULL << order) < pages) order++;
+    return order;
+}
+
+static void add_region(uint64_t base, uint64_t length) {
+    uint64_t first = (base + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t end = (base + length) / PAGE_SIZE;
+    if (end > MAX_PHYS_MEMORY / PAGE_SIZE) end = MAX_PHYS_MEMORY / PAGE_SIZE;
+    if (first >= end || region_count == MAX_REGIONS) return;
+
+    regions[region_count].first = first;
+    regions[region_count].end = end;
+    region_count++;
+}
+
+// Collect the available regions. Reserved, ACPI, NVS and bad RAM entries
+// are simply left out, so their pages stay allocated forever.
+static void read_memory_map(uint64_t multiboot_info) {
+    uint32_t basic_upper_kb = 0;
+    region_count = 0;
+
+    if (multiboot_info) {
+        struct multiboot2_info* info = (struct multiboot2_info*)phys_to_virt(multiboot_info);
+        uint8_t* tag_ptr = (uint8_t*)(info + 1);
+        uint8_t* info_end = (uint8_t*)info + info->total_size;
+
+        while (tag_ptr + sizeof(struct multiboot2_tag) <= info_end) {
+            struct multiboot2_tag* tag = (struct multiboot2_tag*)tag_ptr;
+            if (tag->type == MULTIBOOT2_TAG_END || tag->size < sizeof(struct multiboot2_tag)) break;
+
+            if (tag->type == MULTIBOOT2_TAG_MMAP) {
+                struct multiboot2_tag_mmap* mmap = (struct multiboot2_tag_mmap*)tag;
+                uint8_t* entry = tag_ptr + sizeof(struct multiboot2_tag_mmap);
+                uint8_t* entries_end = tag_ptr + tag->size;
+                for (; entry + sizeof(struct multiboot2_mmap_entry) <= entries_end; entry += mmap->entry_size) {
+                    struct multiboot2_mmap_entry* e = (struct multiboot2_mmap_entry*)entry;
+                    if (e->type == MULTIBOOT2_MEMORY_AVAILABLE) add_region(e->base, e->length);
+                }
+            } else if (tag->type == MULTIBOOT2_TAG_BASIC_MEMINFO) {
+                basic_upper_kb = ((struct multiboot2_tag_basic_meminfo*)tag)->mem_upper;
+            }
+            tag_ptr += (tag->size + 7) & ~7U;
+        }
+    }
+
+    // No map: everything from 1 MB up to the reported (or assumed) size
+    if (region_count == 0) {
+        uint64_t upper_kb = basic_upper_kb ? basic_upper_kb : FALLBACK_MEMORY_KB;
+        add_region(0x100000, upper_kb * 1024);
+    }
+}
+
+// First page at or after page where count pages avoid every excluded range
+static uint64_t skip_excluded(uint64_t page, uint64_t count) {
+    int moved = 1;
+    while (moved) {
+        moved = 0;
+        for (int i = 0; i < excluded_count; i++) {
+            if (page < excluded[i].end && page + count > excluded[i].first) {
+                page = excluded[i].end;
+                moved = 1;
+            }
+        }
+    }
+    return page;
+}
+
+// Free [first, end) minus the excluded ranges from index i on
+static void release_range(uint64_t first, uint64_t end, int i) {
+    for (; i < excluded_count; i++) {
+        if (first < excluded[i].end && end > excluded[i].first) {
+            release_range(first, excluded[i].first, i + 1);
+            release_range(excluded[i].end, end, i + 1);
+            return;
+        }
+    }
+    if (first < end) free_range(first, end - first);
+}
+
+void memory_init(uint64_t multiboot_info, uint64_t kernel_start, uint64_t kernel_end) {
+    read_memory_map(multiboot_info);
+
+    total_pages = 0;
+    usable_pages = 0;
+    for (int i = 0; i < region_count; i++) {
+        if (regions[i].end > total_pages) total_pages = regions[i].end;
+        usable_pages += regions[i].end - regions[i].first;
+    }
+
+    // Size the per-order bitmaps for the RAM that is really there
+    uint64_t words = 0;
+    for (int k = 0; k < MEMORY_ORDERS; k++) {
+        order_words[k] = ((total_pages >> k) + 63) / 64;
+        if (order_words[k] == 0) order_words[k] = 1;
+        words += order_words[k];
+    }
+    bitmap_pages = (words * sizeof(uint64_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // The kernel image and the boot information must not be overwritten
+    // or handed out while we are still reading them
+    uint64_t low_pages = RESERVED_LOW_MEMORY / PAGE_SIZE;
+    excluded_count = 0;
+    excluded[excluded_count].first = kernel_start / PAGE_SIZE;
+    excluded[excluded_count].end = (kernel_end + PAGE_SIZE - 1) / PAGE_SIZE;
+    excluded_count++;
+    if (multiboot_info) {
+        uint32_t info_size = ((struct multiboot2_info*)phys_to_virt(multiboot_info))->total_size;
+        excluded[excluded_count].first = multiboot_info / PAGE_SIZE;
+        excluded[excluded_count].end = (multiboot_info + info_size + PAGE_SIZE - 1) / PAGE_SIZE;
+        excluded_count++;
+    }
+
+    // Put the bitmaps in the first available RAM above the low reserve
+    uint64_t bitmap_page = 0;
+    for (int i = 0; i < region_count && !bitmap_page; i++) {
+        uint64_t first = regions[i].first < low_pages ? low_pages : regions[i].first;
+        first = skip_excluded(first, bitmap_pages);
+        if (first + bitmap_pages <= regions[i].end &&
+            (first + bitmap_pages) * PAGE_SIZE <= BOOT_MAPPED_LIMIT) {
+            bitmap_page = first;
+        }
+    }
+    if (!bitmap_page) {
+        // Nowhere to keep the bookkeeping: leave the allocator empty
+        total_pages = 0;
+        usable_pages = 0;
+        free_pages = 0;
+        bitmap_pages = 0;
+        return;
+    }
+
+    buddy_bitmap = (uint64_t*)phys_to_virt(bitmap_page * PAGE_SIZE);
+    memset((void*)buddy_bitmap, 0, bitmap_pages * PAGE_SIZE);
+    uint64_t offset = 0;
+    for (int k = 0; k < MEMORY_ORDERS; k++) {
+        order_map[k] = &buddy_bitmap[offset];
+        offset += order_words[k];
+    }
+    free_pages = 0;
+
+    uint64_t zone_ends[MEMORY_ZONES] = { ZONE_DMA_END, ZONE_DMA32_END, total_pages };
+    uint64_t zone_first = 0;
+    for (int z = 0; z < MEMORY_ZONES; z++) {
+        zone_t* zone = &zones[z];
+        zone->first = zone_first;
+        zone->end = zone_ends[z] < total_pages ? zone_ends[z] : total_pages;
+        if (zone->end < zone->first) zone->end = zone->first;
+        zone_first = zone->end;
+
+        zone->present = 0;
+        for (int i = 0; i < region_count; i++) {
+            uint64_t first = regions[i].first > zone->first ? regions[i].first : zone->first;
+            uint64_t end = regions[i].end < zone->end ? regions[i].end : zone->end;
+            if (first < end) zone->present += end - first;
+        }
+        zone->free = 0;
+        zone->fallbacks = 0;
+        for (int k = 0; k < MEMORY_ORDERS; k++) {
+            zone->order_free[k] = 0;
+            zone->order_hint[k] = order_words[k] * 64;
+        }
+    }
+
+    // The boot information is consumed now; the bitmaps take its place
+    if (multiboot_info) excluded_count--;
+    excluded[excluded_count].first = bitmap_page;
+    excluded[excluded_count].end = bitmap_page + bitmap_pages;
+    excluded_count++;
+
+    // Low memory stays used; available RAM above it goes in as maximal blocks
+    for (int i = 0; i < region_count; i++) {
+        uint64_t first = regions[i].first < low_pages ? low_pages : regions[i].first;
+        release_range(first, regions[i].end, 0);
+    }
+
+    // DMA memory is scarce and only some devices need it, so hold back more
+    // of it from general allocations than of DMA32
+    zones[ZONE_DMA].watermark = zones[ZONE_DMA].free / 4;
+    zones[ZONE_DMA32].watermark = zones[ZONE_DMA32].free / 16;
+    zones[ZONE_NORMAL].watermark = 0;
+}
+
+void* alloc_frame() {
+    int64_t page = block_alloc(0, ZONE_NORMAL);
+    if (page < 0) return 0;
+    return (void*)((uint64_t)page * PAGE_SIZE);
+}
+
+void* alloc_frame_order(int order) {
+    if (order < 0 || order >= MEMORY_ORDERS) return 0;
+    int64_t page = block_alloc(order, ZONE_NORMAL);
+    if (page < 0) return 0;
+    return (void*)((uint64_t)page * PAGE_SIZE);
+}
+
+void* alloc_frames(uint64_t count, uint64_t align) {
+    return alloc_frames_zone(count, align, ZONE_NORMAL);
+}
+
+// Run of count physically contiguous frames whose base is a multiple of
+// align bytes (a power of two; 0 or PAGE_SIZE for none), all inside zone
+// or a lower one, for DMA buffers. Comes from one buddy block; the unused
+// tail goes straight back.
+void* alloc_frames_zone(uint64_t count, uint64_t align, int zone) {
+    if (count == 0 || zone < 0 || zone >= MEMORY_ZONES) return 0;
+
+    uint64_t align_pages = align / PAGE_SIZE;
+    if (align_pages == 0) align_pages = 1;
+    if (align_pages & (align_pages - 1)) return 0;
+
+    int order = order_for(count > align_pages ? count : align_pages);
+    if (order >= MEMORY_ORDERS) return 0;
+
+    int64_t page = block_alloc(order, zone);
+    if (page < 0) return 0;
+
+    uint64_t block = 1ULL << order;
+    if (count < block) free_range((uint64_t)page + count, block - count);
+    return (void*)((uint64_t)page * PAGE_SIZE);
+}
+
 void free_frame(void* frame) {
-    uint64_t addr = (uint64_t)frame;
-    uint64_t page = addr / PAGE_SIZE;
-    uint64_t idx = page / 64;
-    uint64_t bit = page % 64;
-    memory_bitmap[idx] &= ~(1ULL << bit);
+    uint64_t page = (uint64_t)frame / PAGE_SIZE;
+    if (page >= total_pages || block_has_free(page, 0)) return;
+    block_free(page, 0);
+}
+
+void free_frame_order(void* frame, int order) {
+    if (order < 0 || order >= MEMORY_ORDERS) return;
+    free_frames(frame, 1ULL << order);
+}
+
+void free_frames(void* frame, uint64_t count) {
+    uint64_t first = (uint64_t)frame / PAGE_SIZE;
+    if (first >= total_pages || count > total_pages - first) return;
+    free_range(first, count);
 }
 
 uint64_t get_total_memory() {
-    return total_pages * PAGE_SIZE;
+    return usable_pages * PAGE_SIZE;
+}
+
+uint64_t get_free_memory() {
+    return free_pages * PAGE_SIZE;
+}
+
+int memory_get_region(int index, uint64_t* base, uint64_t* end) {
+    if (index < 0 || index >= region_count) return -1;
+    *base = regions[index].first * PAGE_SIZE;
+    *end = regions[index].end * PAGE_SIZE;
+    return 0;
+}
+
+uint64_t get_free_blocks(int order) {
+    if (order < 0 || order >= MEMORY_ORDERS) return 0;
+    uint64_t blocks = 0;
+    for (int z = 0; z < MEMORY_ZONES; z++) blocks += zones[z].order_free[order];
+    return blocks;
+}
+
+int memory_get_zone_stats(int zone, memory_zone_stats_t* stats) {
+    if (zone < 0 || zone >= MEMORY_ZONES) return -1;
+    zone_t* z = &zones[zone];
+    stats->name = z->name;
+    stats->present_pages = z->present;
+    stats->free_pages = z->free;
+    stats->watermark = z->watermark;
+    stats->fallbacks = z->fallbacks;
+    return 0;
 }
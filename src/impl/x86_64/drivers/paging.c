@@ -1,59 +1,182 @@
 #include "drivers/paging.h"
 #include "drivers/memory.h"
+#include "drivers/heap.h"
+#include "../lib/cpu.h"
 #include <stdint.h>
 
 typedef uint64_t page_entry_t;
 
-static page_entry_t* pml4;
+#define ENTRY_ADDR 0x000FFFFFFFFFF000ULL
+#define SIZE_2MB   (1ULL << 21)
+#define SIZE_1GB   (1ULL << 30)
 
-#define PAGE_TABLE_AREA 0x300000
-static uint64_t next_table = PAGE_TABLE_AREA;
+static page_entry_t* pml4;         // Through the direct map
+static uint64_t pml4_phys;
+static int has_1gb_pages = 0;
 
-static void* alloc_table() {
-    void* t = (void*)next_table;
-    next_table += 0x1000;
-    for (int i = 0; i < 512; i++) ((uint64_t*)t)[i] = 0;
+// TLB features, from CPUID at paging_init. Every mapping here is kernel
+// only, so all of them are global once CR4.PGE is on: a CR3 load keeps
+// them, and invlpg still reaches them under any PCID.
+#define CR4_PGE   (1ULL << 7)
+#define CR4_PCIDE (1ULL << 17)
+#define CR3_NOFLUSH (1ULL << 63)
+static int has_pge = 0;
+static int has_pcid = 0;
+static int has_invpcid = 0;
+static uint64_t global_flag = 0;    // PAGE_GLOBAL when has_pge
+
+// Leaf mappings currently in place, by page size
+static uint64_t pages_4kb = 0;
+static uint64_t pages_2mb = 0;
+static uint64_t pages_1gb = 0;
+
+// Page tables come from the frame allocator and are reached through the
+// direct map. Until paging_init switches to its own tables only the boot
+// tables' first 1 GB of the direct map exists, so early tables are taken
+// from the DMA zone.
+static int direct_map_ready = 0;
+static uint64_t tables_in_use = 0;
+static uint64_t tables_freed = 0;
+
+// Zeroed table frames, filled by the idle loop and by tables that emptied
+// (an empty table is all zeroes already)
+#define ZERO_POOL_TABLES 32
+static uint64_t zero_pool[ZERO_POOL_TABLES];
+static uint32_t zero_pool_count = 0;
+static uint64_t zero_hits = 0;
+static uint64_t zero_misses = 0;
+
+// Unmapping more pages than this in one call flushes the TLB once instead
+// of issuing an invlpg per page
+#define INVLPG_THRESHOLD 32
+static uint64_t invlpg_count = 0;
+static uint64_t full_flushes = 0;
+
+// movnti writes around the cache, so clearing pages for later use does not
+// evict the working set. One 64-byte line per iteration.
+static void zero_page(void* page) {
+    uint64_t* p = (uint64_t*)page;
+    uint64_t* end = p + PAGE_SIZE / sizeof(uint64_t);
+    uint64_t zero = 0;
+    for (; p < end; p += 8) {
+        asm volatile(
+            "movnti %1, 0(%0)\n"
+            "movnti %1, 8(%0)\n"
+            "movnti %1, 16(%0)\n"
+            "movnti %1, 24(%0)\n"
+            "movnti %1, 32(%0)\n"
+            "movnti %1, 40(%0)\n"
+            "movnti %1, 48(%0)\n"
+            "movnti %1, 56(%0)\n"
+            :: "r"(p), "r"(zero) : "memory");
+    }
+    // Non-temporal stores are weakly ordered; drain them before the page is used
+    asm volatile("sfence" ::: "memory");
+}
+
+static uint64_t table_frame() {
+    return (uint64_t)alloc_frames_zone(1, 0, direct_map_ready ? ZONE_NORMAL : ZONE_DMA);
+}
+
+// Physical address of a zeroed table, 0 if out of memory
+static uint64_t alloc_table() {
+    uint64_t t;
+    if (zero_pool_count) {
+        t = zero_pool[--zero_pool_count];
+        zero_hits++;
+    } else {
+        t = table_frame();
+        if (!t) return 0;
+        zero_page(phys_to_virt(t));
+        zero_misses++;
+    }
+    tables_in_use++;
     return t;
 }
 
+static void free_table(uint64_t t) {
+    tables_in_use--;
+    tables_freed++;
+    if (zero_pool_count < ZERO_POOL_TABLES) {
+        zero_pool[zero_pool_count++] = t;
+    } else {
+        free_frame((void*)t);
+    }
+}
+
+// Runs from the idle loop with interrupts on, while the #PF and IRQ paths
+// may pop the pool or allocate frames; only the zeroing itself is left
+// interruptible
+uint32_t paging_prezero_tables(uint32_t max) {
+    uint32_t done = 0;
+    while (done < max) {
+        uint64_t flags = irq_save();
+        uint64_t t = zero_pool_count < ZERO_POOL_TABLES ? table_frame() : 0;
+        irq_restore(flags);
+        if (!t) break;
+
+        zero_page(phys_to_virt(t));
+
+        flags = irq_save();
+        if (zero_pool_count < ZERO_POOL_TABLES) {
+            zero_pool[zero_pool_count++] = t;
+        } else {
+            free_frame((void*)t);   // Filled by freed tables meanwhile
+        }
+        irq_restore(flags);
+        done++;
+    }
+    return done;
+}
+
+void paging_get_zero_stats(uint64_t* pooled, uint64_t* hits, uint64_t* misses) {
+    *pooled = zero_pool_count;
+    *hits = zero_hits;
+    *misses = zero_misses;
+}
+
 void paging_init(uint64_t phys_base, uint64_t phys_end,
                  uint64_t heap_start, uint64_t heap_size) {
-    pml4 = (page_entry_t*)alloc_table();
+    pml4_phys = alloc_table();
+    pml4 = (page_entry_t*)phys_to_virt(pml4_phys);
 
-    // IMPORTANT: Pre-allocate and identity map ALL page tables we'll need
-    // Calculate how many page tables we need for kernel
-    uint64_t kernel_pages = (phys_end - phys_base) / PAGE_SIZE;
-    uint64_t heap_pages = heap_size / PAGE_SIZE;
-    uint64_t table_pages = (next_table - PAGE_TABLE_AREA) / PAGE_SIZE;
-    
-    // Estimate total tables needed (rough upper bound)
-    uint64_t total_pages = kernel_pages + heap_pages + table_pages + 100; // +100 for safety
-    uint64_t tables_needed = (total_pages / 512) + 10; // Pages per table + overhead
-    
-    // Pre-allocate tables
-    for (uint64_t i = 0; i < tables_needed; i++) {
-        alloc_table();
-    }
-    
-    // NOW identity map everything BEFORE enabling paging
-    // Identity map kernel
-    for (uint64_t addr = phys_base; addr < phys_end; addr += PAGE_SIZE) {
-        map_page(addr, addr, PAGE_PRESENT | PAGE_RW);
-    }
+    // 1 GB pages are optional (CPUID 0x80000001, EDX bit 26); 2 MB pages
+    // are always there in long mode
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000001));
+    has_1gb_pages = (edx >> 26) & 1;
 
-    // Identity map heap
-    for (uint64_t addr = heap_start; addr < heap_start + heap_size; addr += PAGE_SIZE) {
-        map_page(addr, addr, PAGE_PRESENT | PAGE_RW);
+    // Global pages (leaf 1, EDX bit 13), PCID (leaf 1, ECX bit 17) and
+    // INVPCID (leaf 7, EBX bit 10)
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    uint32_t max_leaf = eax;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    has_pge = (edx >> 13) & 1;
+    has_pcid = (ecx >> 17) & 1;
+    if (max_leaf >= 7) {
+        asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+        has_invpcid = (ebx >> 10) & 1;
     }
+    if (has_pge) global_flag = PAGE_GLOBAL;
 
-    // Identity map ALL page tables (including those we just allocated)
-    for (uint64_t addr = PAGE_TABLE_AREA; addr < next_table; addr += PAGE_SIZE) {
-        map_page(addr, addr, PAGE_PRESENT | PAGE_RW);
+    // Kernel image at its link address in the top 2 GB
+    map_range(KERNEL_VMA + phys_base, phys_base, phys_end - phys_base, PAGE_PRESENT | PAGE_RW);
+
+    // Map the initial heap at its virtual base; kmalloc grows it from there
+    map_range(HEAP_VIRT_BASE, heap_start, heap_size, PAGE_PRESENT | PAGE_RW);
+
+    // Direct map of all available RAM, 1 GB or 2 MB pages wherever the
+    // regions allow. Holes and device memory stay out of it.
+    uint64_t base, end;
+    for (int i = 0; memory_get_region(i, &base, &end) == 0; i++) {
+        map_range(DIRECT_MAP_BASE + base, base, end - base, PAGE_PRESENT | PAGE_RW);
     }
 
-    // Identity map video memory (0xB8000)
-    map_page(0xB8000, 0xB8000, PAGE_PRESENT | PAGE_RW);
+    // Video memory (0xB8000), where print.c expects it
+    map_page((uint64_t)phys_to_virt(0xB8000), 0xB8000, PAGE_PRESENT | PAGE_RW);
 
+    // Nothing is identity mapped from here on: the boot code already moved
+    // the stack and GDT to their higher-half addresses
     asm volatile("cli");
 
     // Enable PAE (CR4.PAE = bit 5)
@@ -63,7 +186,7 @@ void paging_init(uint64_t phys_base, uint64_t phys_end,
     asm volatile("mov %0, %%cr4" :: "r"(cr4));
 
     // Load PML4
-    asm volatile("mov %0, %%cr3" :: "r"((uint64_t)pml4));
+    asm volatile("mov %0, %%cr3" :: "r"(pml4_phys));
 
     // Enable paging (CR0.PG = bit 31)
     uint64_t cr0;
@@ -71,42 +194,343 @@ void paging_init(uint64_t phys_base, uint64_t phys_end,
     cr0 |= (1UL << 31);
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
 
+    // The G bits are already in the new tables; PCIDE needs PCID 0 in CR3,
+    // which the kernel keeps
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    if (has_pge) cr4 |= CR4_PGE;
+    if (has_pcid) cr4 |= CR4_PCIDE;
+    asm volatile("mov %0, %%cr4" :: "r"(cr4));
+
+    direct_map_ready = 1;
+
     asm volatile("sti");
 }
 
-void map_page(uint64_t virt, uint64_t phys, uint64_t flags) {
-    uint64_t pml4_idx = (virt >> 39) & 0x1FF;
-    uint64_t pdpt_idx = (virt >> 30) & 0x1FF;
-    uint64_t pd_idx   = (virt >> 21) & 0x1FF;
-    uint64_t pt_idx   = (virt >> 12) & 0x1FF;
+// Entry for virt at a level (4 = PML4, 3 = PDPT, 2 = PD, 1 = PT), creating
+// missing tables above it. 0 if out of tables, or if a huge page above the
+// level already covers virt.
+static page_entry_t* walk(uint64_t virt, int level, int create) {
+    page_entry_t* table = pml4;
+    for (int l = 4; l > level; l--) {
+        page_entry_t* entry = &table[(virt >> (12 + 9 * (l - 1))) & 0x1FF];
+        if (!(*entry & PAGE_PRESENT)) {
+            uint64_t next;
+            if (!create || !(next = alloc_table())) return 0;
+            *entry = next | PAGE_PRESENT | PAGE_RW;
+        } else if (*entry & PAGE_HUGE) {
+            return 0;
+        }
+        table = (page_entry_t*)phys_to_virt(*entry & ENTRY_ADDR);
+    }
+    return &table[(virt >> (12 + 9 * (level - 1))) & 0x1FF];
+}
 
-    page_entry_t *pdpt, *pd, *pt;
+// Walk to the page table entry for virt, optionally creating missing levels
+static page_entry_t* get_pte(uint64_t virt, int create) {
+    return walk(virt, 1, create);
+}
 
-    // Get or create PDPT
-    if (!(pml4[pml4_idx] & PAGE_PRESENT)) {
-        pdpt = (page_entry_t*)alloc_table();
-        pml4[pml4_idx] = ((uint64_t)pdpt) | PAGE_PRESENT | PAGE_RW;
-    } else {
-        // FIX: Since we identity-mapped, phys addr = virt addr
-        pdpt = (page_entry_t*)(pml4[pml4_idx] & ~0xFFF);
+// Scans from hint, the slot last cleared: when a range is torn down in
+// order, its neighbour is the one still in use and the scan stops there
+static int table_is_empty(page_entry_t* t, uint64_t hint) {
+    for (int i = 0; i < 512; i++) {
+        if (t[(hint + i) & 0x1FF]) return 0;
     }
+    return 1;
+}
 
-    // Get or create PD
-    if (!(pdpt[pdpt_idx] & PAGE_PRESENT)) {
-        pd = (page_entry_t*)alloc_table();
-        pdpt[pdpt_idx] = ((uint64_t)pd) | PAGE_PRESENT | PAGE_RW;
-    } else {
-        pd = (page_entry_t*)(pdpt[pdpt_idx] & ~0xFFF);
+// Free the table at level (1 = PT, 2 = PD, 3 = PDPT) that maps virt if
+// nothing is left in it, then its parents the same way. The PML4 stays.
+// Returns how many tables went. The caller still owes a TLB flush for
+// virt, which also drops paging-structure cache entries for freed tables.
+static int prune_tables(uint64_t virt, int level) {
+    int freed = 0;
+    for (; level < 4; level++) {
+        page_entry_t* entry = walk(virt, level + 1, 0);
+        if (!entry || !(*entry & PAGE_PRESENT) || (*entry & PAGE_HUGE)) break;
+
+        uint64_t table = *entry & ENTRY_ADDR;
+        if (!table_is_empty((page_entry_t*)phys_to_virt(table),
+                            (virt >> (12 + 9 * (level - 1))) & 0x1FF)) break;
+        *entry = 0;
+        free_table(table);
+        freed++;
     }
+    return freed;
+}
+
+static void flush_page(uint64_t virt) {
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    invlpg_count++;
+}
+
+// invpcid types: one address in one PCID, one PCID, everything including
+// global entries, everything but global entries
+#define INVPCID_ADDRESS     0
+#define INVPCID_CONTEXT     1
+#define INVPCID_ALL_GLOBAL  2
+
+static void invpcid(uint64_t type, uint64_t pcid, uint64_t addr) {
+    struct { uint64_t pcid; uint64_t addr; } desc = { pcid, addr };
+    asm volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
+static uint64_t read_cr4() {
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static void write_cr4(uint64_t cr4) {
+    asm volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+}
 
-    // Get or create PT
-    if (!(pd[pd_idx] & PAGE_PRESENT)) {
-        pt = (page_entry_t*)alloc_table();
-        pd[pd_idx] = ((uint64_t)pt) | PAGE_PRESENT | PAGE_RW;
+// Global entries survive a CR3 load, so a full flush has to drop them some
+// other way: invpcid if there is one, else a CR4.PGE round trip (which
+// also clears every PCID)
+static void flush_all() {
+    uint64_t cr4 = read_cr4();
+    if (has_invpcid) {
+        invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+    } else if (cr4 & CR4_PGE) {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
     } else {
-        pt = (page_entry_t*)(pd[pd_idx] & ~0xFFF);
+        uint64_t cr3;
+        asm volatile("mov %%cr3, %0" : "=r"(cr3));
+        asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
     }
+    full_flushes++;
+}
+
+void paging_flush_tlb() {
+    flush_all();
+}
+
+int paging_set_global(int on) {
+    uint64_t cr4 = read_cr4();
+    int was = (cr4 & CR4_PGE) != 0;
+    if (!has_pge) return 0;
+    // Any change of CR4.PGE flushes the whole TLB
+    write_cr4(on ? (cr4 | CR4_PGE) : (cr4 & ~CR4_PGE));
+    return was;
+}
+
+uint64_t paging_kernel_space() {
+    return pml4_phys;
+}
+
+uint64_t paging_clone_space() {
+    uint64_t phys = alloc_table();
+    if (!phys) return 0;
+    page_entry_t* copy = (page_entry_t*)phys_to_virt(phys);
+    for (int i = 0; i < 512; i++) copy[i] = pml4[i];
+    return phys;
+}
+
+void paging_switch(uint64_t space, uint16_t pcid, int keep) {
+    uint64_t cr3 = space;
+    if (has_pcid) {
+        cr3 |= pcid & 0xFFF;
+        if (keep) cr3 |= CR3_NOFLUSH;
+    }
+    asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+}
+
+void paging_release_space(uint64_t space, uint16_t pcid) {
+    // Entries tagged with the PCID outlive the switch away from it; drop
+    // them so the tag can be reused with other tables
+    if (has_pcid && pcid) {
+        if (has_invpcid) {
+            invpcid(INVPCID_CONTEXT, pcid, 0);
+        } else {
+            uint64_t cr3;
+            asm volatile("mov %%cr3, %0" : "=r"(cr3));
+            paging_switch(space, pcid, 0);
+            asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+        }
+    }
+    page_entry_t* copy = (page_entry_t*)phys_to_virt(space);
+    for (int i = 0; i < 512; i++) copy[i] = 0;
+    free_table(space);
+}
+
+int map_page(uint64_t virt, uint64_t phys, uint64_t flags) {
+    page_entry_t* pte = get_pte(virt, 1);
+    if (!pte) return -1;  // Out of page tables
+
+    if (!(*pte & PAGE_PRESENT)) pages_4kb++;
 
     // Map the actual page
-    pt[pt_idx] = (phys & ~0xFFF) | (flags & 0xFFF) | PAGE_PRESENT;
-}
\ No newline at end of file
+    *pte = (phys & ~0xFFF) | (flags & 0xFFF) | PAGE_PRESENT | global_flag;
+    return 0;
+}
+
+// Put a huge page in the entry at level (3 = 1 GB, 2 = 2 MB). An empty
+// table hanging there is recycled; one still in use keeps its 4 KB pages.
+static int map_huge(uint64_t virt, uint64_t phys, uint64_t flags, int level) {
+    page_entry_t* entry = walk(virt, level, 1);
+    if (!entry) return -1;
+
+    if (*entry & PAGE_PRESENT) {
+        if (!(*entry & PAGE_HUGE)) {
+            uint64_t table = *entry & ENTRY_ADDR;
+            if (!table_is_empty((page_entry_t*)phys_to_virt(table), 0)) return -1;
+            free_table(table);
+        } else if (level == 3) {
+            pages_1gb--;
+        } else {
+            pages_2mb--;
+        }
+        *entry = 0;
+        flush_page(virt);
+    }
+
+    *entry = phys | (flags & 0xFFF) | PAGE_PRESENT | PAGE_HUGE | global_flag;
+    if (level == 3) pages_1gb++;
+    else pages_2mb++;
+    return 0;
+}
+
+int map_range(uint64_t virt, uint64_t phys, uint64_t len, uint64_t flags) {
+    uint64_t end = virt + ((len + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1));
+    flags &= ~(uint64_t)PAGE_HUGE;  // Bit 7 is PAT in a 4 KB entry
+
+    while (virt < end) {
+        uint64_t left = end - virt;
+        uint64_t both = virt | phys;
+
+        if (has_1gb_pages && !(both & (SIZE_1GB - 1)) && left >= SIZE_1GB &&
+            map_huge(virt, phys, flags, 3) == 0) {
+            virt += SIZE_1GB;
+            phys += SIZE_1GB;
+            continue;
+        }
+        if (!(both & (SIZE_2MB - 1)) && left >= SIZE_2MB &&
+            map_huge(virt, phys, flags, 2) == 0) {
+            virt += SIZE_2MB;
+            phys += SIZE_2MB;
+            continue;
+        }
+        if (map_page(virt, phys, flags) != 0) return -1;
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+    }
+    return 0;
+}
+
+uint64_t unmap_page(uint64_t virt) {
+    page_entry_t* pte = get_pte(virt, 0);
+    if (!pte || !(*pte & PAGE_PRESENT)) return 0;
+
+    uint64_t phys = *pte & ~0xFFFULL;
+    *pte = 0;
+    pages_4kb--;
+    prune_tables(virt, 1);
+    flush_page(virt);
+    return phys;
+}
+
+void unmap_range(uint64_t virt, uint64_t len) {
+    uint64_t end = virt + ((len + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1));
+
+    // Entries cleared so far; past the threshold, stop invalidating them
+    // one by one and reload CR3 at the end instead
+    uint64_t cleared = 0;
+
+    while (virt < end) {
+        uint64_t left = end - virt;
+
+        // Nothing mapped under this PDPT or PD entry: skip all of it
+        page_entry_t* pdpte = walk(virt, 3, 0);
+        if (!pdpte || !(*pdpte & PAGE_PRESENT)) {
+            virt = (virt | (SIZE_1GB - 1)) + 1;
+            continue;
+        }
+        if (*pdpte & PAGE_HUGE) {
+            // Huge pages go as a whole; a range that cuts one leaves it be
+            if (!(virt & (SIZE_1GB - 1)) && left >= SIZE_1GB) {
+                *pdpte = 0;
+                pages_1gb--;
+                prune_tables(virt, 3);
+                if (++cleared <= INVLPG_THRESHOLD) flush_page(virt);
+            }
+            virt = (virt | (SIZE_1GB - 1)) + 1;
+            continue;
+        }
+
+        page_entry_t* pde = walk(virt, 2, 0);
+        if (!(*pde & PAGE_PRESENT)) {
+            virt = (virt | (SIZE_2MB - 1)) + 1;
+            continue;
+        }
+        if (*pde & PAGE_HUGE) {
+            if (!(virt & (SIZE_2MB - 1)) && left >= SIZE_2MB) {
+                *pde = 0;
+                pages_2mb--;
+                prune_tables(virt, 2);
+                if (++cleared <= INVLPG_THRESHOLD) flush_page(virt);
+            }
+            virt = (virt | (SIZE_2MB - 1)) + 1;
+            continue;
+        }
+
+        // Clear what this page table maps of the range, then see whether
+        // the table itself can go
+        uint64_t table_end = (virt | (SIZE_2MB - 1)) + 1;
+        if (table_end > end) table_end = end;
+        page_entry_t* pte = walk(virt, 1, 0);
+        uint64_t last = virt;
+        for (; virt < table_end; virt += PAGE_SIZE, pte++) {
+            if (!(*pte & PAGE_PRESENT)) continue;
+            *pte = 0;
+            pages_4kb--;
+            if (++cleared <= INVLPG_THRESHOLD) flush_page(virt);
+            last = virt;
+        }
+        // The invlpgs above may predate the table going away
+        if (prune_tables(last, 1) && cleared <= INVLPG_THRESHOLD) flush_page(last);
+    }
+
+    if (cleared > INVLPG_THRESHOLD) flush_all();
+}
+
+// paging_init only direct maps RAM. Firmware tables and device registers
+// get their pages here, at the same offset, on demand; pages that are
+// already mapped (RAM, or an earlier call) keep their mapping.
+void* paging_map_phys(uint64_t phys, uint64_t len, uint64_t flags) {
+    if (phys + len > DIRECT_MAP_SIZE) return 0;
+
+    uint64_t end = phys + len;
+    for (uint64_t page = phys & ~(uint64_t)(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        uint64_t virt = (uint64_t)phys_to_virt(page);
+        if (paging_translate(virt)) continue;
+        if (map_page(virt, page, flags) != 0) return 0;
+    }
+    return phys_to_virt(phys);
+}
+
+uint64_t paging_translate(uint64_t virt) {
+    for (int level = 3; level >= 1; level--) {
+        page_entry_t* entry = walk(virt, level, 0);
+        if (!entry || !(*entry & PAGE_PRESENT)) return 0;
+        if (level == 1 || (*entry & PAGE_HUGE)) {
+            uint64_t page_mask = (1ULL << (12 + 9 * (level - 1))) - 1;
+            return (*entry & ENTRY_ADDR & ~page_mask) | (virt & page_mask);
+        }
+    }
+    return 0;
+}
+
+void paging_get_stats(paging_stats_t* stats) {
+    stats->tables = tables_in_use;
+    stats->tables_freed = tables_freed;
+    stats->pages_4kb = pages_4kb;
+    stats->pages_2mb = pages_2mb;
+    stats->pages_1gb = pages_1gb;
+    stats->invlpg = invlpg_count;
+    stats->full_flushes = full_flushes;
+    stats->global_pages = (read_cr4() & CR4_PGE) != 0;
+    stats->pcid = has_pcid;
+    stats->invpcid = has_invpcid;
+}
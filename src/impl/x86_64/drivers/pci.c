@@ -1,5 +1,8 @@
 #include "drivers/pci.h"
 #include "../lib/ports.h" // inb/outb
+#include "drivers/paging.h"
+#include "drivers/apic.h"
+#include "core/irq.h"
 #include <stdint.h>
 
 #define PCI_CONFIG_ADDRESS 0xCF8
@@ -32,12 +35,19 @@ uint8_t pci_config_read_byte(uint8_t bus, uint8_t slot, uint8_t func, uint8_t of
     return (d >> ((offset & 3) * 8)) & 0xFF;
 }
 
+// A 16-bit write to the word's own half of the data port. Merging it into
+// a dword would write the neighbouring word back too: the status register
+// next to the command register has write-one-to-clear bits, and the MSI
+// control word shares its dword with the capability ID and next pointer.
 void pci_config_write_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value) {
-    uint32_t d = pci_config_read_dword(bus, slot, func, offset & 0xFC);
-    uint32_t shift = (offset & 3) * 8;
-    uint32_t mask = 0xFFFFu << shift;
-    d = (d & ~mask) | ((uint32_t)value << shift);
-    pci_config_write_dword(bus, slot, func, offset, d);
+    uint32_t address =
+        (uint32_t)((uint32_t)bus << 16) |
+        (uint32_t)((uint32_t)slot << 11) |
+        (uint32_t)((uint32_t)func << 8) |
+        (uint32_t)(offset & 0xFC) |
+        (uint32_t)0x80000000;
+    outl(PCI_CONFIG_ADDRESS, address);
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
 }
 
 int pci_find_device(uint16_t vendor_id, uint16_t device_id, uint8_t *bus_out, uint8_t *slot_out, uint8_t *func_out) {
@@ -74,3 +84,210 @@ int pci_find_device(uint16_t vendor_id, uint16_t device_id, uint8_t *bus_out, ui
     }
     return -1;
 }
+
+uint16_t pci_config_read_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t d = pci_config_read_dword(bus, slot, func, offset & 0xFC);
+    return (d >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+// Standard header registers
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_BAR0            0x10
+#define PCI_CAP_PTR         0x34
+
+#define PCI_CMD_MEMORY      (1 << 1)
+#define PCI_CMD_INTX_OFF    (1 << 10)
+#define PCI_STATUS_CAPS     (1 << 4)
+
+// MSI capability: control word, then address (64-bit if flagged), data
+#define MSI_CTRL            0x02
+#define MSI_ADDR_LOW        0x04
+#define MSI_ADDR_HIGH       0x08
+#define MSI_CTRL_ENABLE     (1 << 0)
+#define MSI_CTRL_64BIT      (1 << 7)
+
+// MSI-X capability: control word, table and PBA as BAR index + offset
+#define MSIX_CTRL           0x02
+#define MSIX_TABLE          0x04
+#define MSIX_CTRL_ENABLE    (1 << 15)
+#define MSIX_CTRL_MASK_ALL  (1 << 14)
+#define MSIX_ENTRY_SIZE     16
+#define MSIX_VECTOR_MASKED  1
+
+// Messages go to the local APIC's window: destination ID in bits 12-19,
+// fixed delivery and edge trigger (both 0) in the data word
+#define MSI_ADDRESS_BASE    0xFEE00000u
+
+typedef struct {
+    uint8_t used;
+    uint8_t bus, slot, func;
+    uint8_t cap;            // Offset of the capability that was enabled
+    uint8_t msix;
+    uint8_t first_line;     // MSI: one aligned block
+    uint8_t count;
+    uint8_t lines[32];      // MSI-X: a line per table entry
+} msi_device_t;
+
+static msi_device_t msi_devices[PCI_MSI_DEVICES];
+
+uint8_t pci_find_capability(uint8_t bus, uint8_t slot, uint8_t func, uint8_t cap_id) {
+    if (!(pci_config_read_word(bus, slot, func, PCI_STATUS) & PCI_STATUS_CAPS)) return 0;
+
+    // Bound the walk in case a broken list loops
+    uint8_t cap = pci_config_read_byte(bus, slot, func, PCI_CAP_PTR) & 0xFC;
+    for (int i = 0; cap && i < 48; i++) {
+        if (pci_config_read_byte(bus, slot, func, cap) == cap_id) return cap;
+        cap = pci_config_read_byte(bus, slot, func, cap + 1) & 0xFC;
+    }
+    return 0;
+}
+
+static uint32_t msi_address(void) {
+    return MSI_ADDRESS_BASE | ((apic_id() & 0xFF) << 12);
+}
+
+// Memory BAR as a physical address, 64-bit BARs included; 0 for I/O
+static uint64_t pci_bar_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t bar) {
+    uint8_t offset = PCI_BAR0 + bar * 4;
+    uint32_t low = pci_config_read_dword(bus, slot, func, offset);
+    if (low & 1) return 0;
+
+    uint64_t addr = low & ~0xFu;
+    if (((low >> 1) & 3) == 2) {
+        addr |= (uint64_t)pci_config_read_dword(bus, slot, func, offset + 4) << 32;
+    }
+    return addr;
+}
+
+static int enable_msix(msi_device_t *dev, uint8_t *lines, uint32_t count) {
+    uint8_t bus = dev->bus, slot = dev->slot, func = dev->func;
+    uint8_t cap = pci_find_capability(bus, slot, func, PCI_CAP_MSIX);
+    if (!cap) return -1;
+
+    uint16_t ctrl = pci_config_read_word(bus, slot, func, cap + MSIX_CTRL);
+    uint32_t table_size = (ctrl & 0x7FF) + 1;
+    if (count > table_size) count = table_size;
+    if (count > sizeof(dev->lines)) count = sizeof(dev->lines);
+
+    uint32_t table = pci_config_read_dword(bus, slot, func, cap + MSIX_TABLE);
+    uint64_t bar = pci_bar_address(bus, slot, func, table & 7);
+    if (!bar) return -1;
+    volatile uint32_t *entries = paging_map_phys(bar + (table & ~7u), table_size * MSIX_ENTRY_SIZE,
+                                                 PAGE_PRESENT | PAGE_RW | PAGE_PCD | PAGE_PWT);
+    if (!entries) return -1;
+
+    uint32_t got = 0;
+    for (; got < count; got++) {
+        int line = irq_alloc_lines(1);
+        if (line < 0) break;
+        dev->lines[got] = (uint8_t)line;
+    }
+    if (got == 0) return -1;
+
+    uint32_t cmd = pci_config_read_dword(bus, slot, func, PCI_COMMAND);
+    pci_config_write_word(bus, slot, func, PCI_COMMAND,
+                          (uint16_t)(cmd | PCI_CMD_MEMORY | PCI_CMD_INTX_OFF));
+
+    // Program the table with the function masked, then let it go
+    pci_config_write_word(bus, slot, func, cap + MSIX_CTRL, ctrl | MSIX_CTRL_ENABLE | MSIX_CTRL_MASK_ALL);
+    for (uint32_t i = 0; i < table_size; i++) {
+        volatile uint32_t *e = entries + i * (MSIX_ENTRY_SIZE / 4);
+        if (i < got) {
+            e[0] = msi_address();
+            e[1] = 0;
+            e[2] = IRQ_BASE_VECTOR + dev->lines[i];
+            e[3] = 0;
+        } else {
+            e[3] = MSIX_VECTOR_MASKED;
+        }
+    }
+    pci_config_write_word(bus, slot, func, cap + MSIX_CTRL,
+                          (ctrl | MSIX_CTRL_ENABLE) & ~MSIX_CTRL_MASK_ALL);
+
+    dev->cap = cap;
+    dev->msix = 1;
+    dev->count = (uint8_t)got;
+    for (uint32_t i = 0; i < got; i++) lines[i] = dev->lines[i];
+    return (int)got;
+}
+
+static int enable_msi(msi_device_t *dev, uint8_t *lines, uint32_t count) {
+    uint8_t bus = dev->bus, slot = dev->slot, func = dev->func;
+    uint8_t cap = pci_find_capability(bus, slot, func, PCI_CAP_MSI);
+    if (!cap) return -1;
+
+    // Messages come in power-of-two blocks up to what the device can do
+    uint16_t ctrl = pci_config_read_word(bus, slot, func, cap + MSI_CTRL);
+    uint32_t capable = 1u << ((ctrl >> 1) & 7);
+    uint32_t log2 = 0;
+    while ((2u << log2) <= count && (2u << log2) <= capable) log2++;
+
+    int first;
+    while ((first = irq_alloc_lines(1u << log2)) < 0) {
+        if (log2 == 0) return -1;
+        log2--;
+    }
+    uint32_t got = 1u << log2;
+
+    uint8_t data = cap + ((ctrl & MSI_CTRL_64BIT) ? 0x0C : 0x08);
+    pci_config_write_dword(bus, slot, func, cap + MSI_ADDR_LOW, msi_address());
+    if (ctrl & MSI_CTRL_64BIT) pci_config_write_dword(bus, slot, func, cap + MSI_ADDR_HIGH, 0);
+    pci_config_write_word(bus, slot, func, data, IRQ_BASE_VECTOR + first);
+
+    uint32_t cmd = pci_config_read_dword(bus, slot, func, PCI_COMMAND);
+    pci_config_write_word(bus, slot, func, PCI_COMMAND, (uint16_t)(cmd | PCI_CMD_INTX_OFF));
+    ctrl = (ctrl & ~(7 << 4)) | (log2 << 4) | MSI_CTRL_ENABLE;
+    pci_config_write_word(bus, slot, func, cap + MSI_CTRL, ctrl);
+
+    dev->cap = cap;
+    dev->msix = 0;
+    dev->first_line = (uint8_t)first;
+    dev->count = (uint8_t)got;
+    for (uint32_t i = 0; i < got; i++) lines[i] = (uint8_t)(first + i);
+    return (int)got;
+}
+
+int pci_enable_msi(uint8_t bus, uint8_t slot, uint8_t func, uint8_t *lines, uint32_t count) {
+    // Messages are writes to a local APIC; there is none behind the 8259
+    if (!apic_active() || count == 0) return -1;
+
+    msi_device_t *dev = 0;
+    for (int i = 0; i < PCI_MSI_DEVICES; i++) {
+        if (!msi_devices[i].used) {
+            dev = &msi_devices[i];
+            break;
+        }
+    }
+    if (!dev) return -1;
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+
+    int got = enable_msix(dev, lines, count);
+    if (got < 0) got = enable_msi(dev, lines, count);
+    if (got > 0) dev->used = 1;
+    return got;
+}
+
+void pci_disable_msi(uint8_t bus, uint8_t slot, uint8_t func) {
+    for (int i = 0; i < PCI_MSI_DEVICES; i++) {
+        msi_device_t *dev = &msi_devices[i];
+        if (!dev->used || dev->bus != bus || dev->slot != slot || dev->func != func) continue;
+
+        uint8_t ctrl_off = dev->cap + 2;
+        uint16_t ctrl = pci_config_read_word(bus, slot, func, ctrl_off);
+        if (dev->msix) {
+            pci_config_write_word(bus, slot, func, ctrl_off, ctrl & ~MSIX_CTRL_ENABLE);
+            for (uint32_t n = 0; n < dev->count; n++) irq_free_lines(dev->lines[n], 1);
+        } else {
+            pci_config_write_word(bus, slot, func, ctrl_off, ctrl & ~MSI_CTRL_ENABLE);
+            irq_free_lines(dev->first_line, dev->count);
+        }
+
+        uint32_t cmd = pci_config_read_dword(bus, slot, func, PCI_COMMAND);
+        pci_config_write_word(bus, slot, func, PCI_COMMAND, (uint16_t)(cmd & ~PCI_CMD_INTX_OFF));
+        dev->used = 0;
+        return;
+    }
+}
@@ -1,29 +1,92 @@
+#include "drivers/pic.h"
+#include "../lib/ports.h"
 #include <stdint.h>
 
-static inline void outb(uint16_t port, uint8_t val) {
-    __asm__ volatile("outb %0, %1" : : "a"(val), "Nd"(port));
-}
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
 
-void pic_remap() {
-    uint8_t a1, a2;
+#define PIC_EOI      0x20
+#define PIC_READ_ISR 0x0B
+#define PIC_CASCADE  2
 
+void pic_remap() {
     // start init
-    outb(0x20, 0x11);
-    outb(0xA0, 0x11);
+    outb(PIC1_CMD, 0x11);
+    outb(PIC2_CMD, 0x11);
 
     // set offsets
-    outb(0x21, 0x20); // Master PIC vector offset = 0x20
-    outb(0xA1, 0x28); // Slave PIC offset = 0x28
+    outb(PIC1_DATA, 0x20); // Master PIC vector offset = 0x20
+    outb(PIC2_DATA, 0x28); // Slave PIC offset = 0x28
 
     // tell master/slave about each other
-    outb(0x21, 0x04);
-    outb(0xA1, 0x02);
+    outb(PIC1_DATA, 0x04);
+    outb(PIC2_DATA, 0x02);
 
     // set mode
-    outb(0x21, 0x01);
-    outb(0xA1, 0x01);
+    outb(PIC1_DATA, 0x01);
+    outb(PIC2_DATA, 0x01);
+
+    // mask everything; irq_register unmasks lines as handlers arrive
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask(uint8_t line) {
+    if (line < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << line));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (line - 8)));
+        // Slave lines only get through with the cascade open
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << PIC_CASCADE));
+    }
+}
+
+void pic_mask(uint8_t line) {
+    if (line < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) | (1 << line));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (line - 8)));
+    }
+}
 
-    // unmask keyboard (IRQ1)
-    outb(0x21, 0xFD); // 11111101 -> enable only IRQ1
-    outb(0xA1, 0xFF);
+void pic_disable() {
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
 }
+
+void pic_eoi(uint8_t line) {
+    if (line >= PIC_LINES) return;     // Not one of ours
+    if (line >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+static uint8_t read_isr(uint16_t cmd) {
+    outb(cmd, PIC_READ_ISR);
+    return inb(cmd);
+}
+
+int pic_spurious(uint8_t line) {
+    if (line == 7) return !(read_isr(PIC1_CMD) & 0x80);
+    if (line == 15 && !(read_isr(PIC2_CMD) & 0x80)) {
+        // The master did see a real cascade interrupt from the slave
+        outb(PIC1_CMD, PIC_EOI);
+        return 1;
+    }
+    return 0;
+}
+
+// The 8259 pair is left in edge mode; PCI lines still work through it
+static void pic_chip_unmask(uint8_t line, int trigger) {
+    pic_unmask(line);
+}
+
+const irq_chip_t pic_chip = {
+    .name = "8259 PIC",
+    .lines = PIC_LINES,
+    .unmask = pic_chip_unmask,
+    .mask = pic_mask,
+    .eoi = pic_eoi,
+    .spurious = pic_spurious,
+};
@@ -3,6 +3,9 @@
 #include "../lib/ports.h"
 #include "lib/print.h"
 #include "drivers/heap.h"   // kmalloc/kfree
+#include "drivers/memory.h" // ZONE_DMA32
+#include "core/irq.h"
+#include "core/softirq.h"
 #include <stdint.h>
 #include "lib/string.h" // if available
 
@@ -36,6 +39,9 @@ static uint8_t irq_line = 0xFF;
 static uint8_t *rx_buf_virt = 0;
 static uint32_t rx_buf_phys = 0;
 static uint32_t rx_offset = 0;
+static int rx_softirq = -1;
+
+static void rtl8139_handle_rx(void *ctx);
 
 static inline void outb_io(uint16_t reg, uint8_t val) { outb(io_base + reg, val); }
 static inline uint8_t inb_io(uint16_t reg) { return inb(io_base + reg); }
@@ -44,13 +50,6 @@ static inline uint16_t inw_io(uint16_t reg) { return inw(io_base + reg); }
 static inline void outl_io(uint16_t reg, uint32_t val) { outl(io_base + reg, val); }
 static inline uint32_t inl_io(uint16_t reg) { return inl(io_base + reg); }
 
-/* Simple memcopy if not available */
-static void simple_memcpy(void *dst, const void *src, size_t n) {
-    uint8_t *d = dst;
-    const uint8_t *s = src;
-    while (n--) *d++ = *s++;
-}
-
 /* helper: read PCI BAR0 (I/O base) */
 static uint32_t pci_get_bar0(uint8_t bus, uint8_t slot, uint8_t func) {
     uint32_t bar = pci_config_read_dword(bus, slot, func, 0x10);
@@ -61,11 +60,6 @@ static uint32_t pci_get_bar0(uint8_t bus, uint8_t slot, uint8_t func) {
     return 0; // we expect IO BAR for many RTL8139 in QEMU
 }
 
-/* Convert virtual to physical if you need; here assume identity mapping */
-static uint32_t virt_to_phys(void* v) {
-    return (uint32_t)(uintptr_t)v;
-}
-
 int rtl8139_probe_init(void) {
     uint8_t bus=0, slot=0, func=0;
     if (pci_find_device(0x10EC, 0x8139, &bus, &slot, &func) != 0) {
@@ -99,16 +93,24 @@ int rtl8139_probe_init(void) {
     /* Put config1 0x00 to power on */
     outb_io(RTL_REG_CONFIG1, 0x00);
 
-    /* Allocate RX buffer (8192 + 16 recommended) */
-    rx_buf_virt = kmalloc(RTL_RX_BUF_SIZE);
+    /* Allocate RX buffer (8192 + 16 recommended), whole pages so the
+       card sees one physically contiguous range. RBSTART is 32 bits wide,
+       so the buffer has to sit below 4 GB */
+    rx_buf_virt = kmalloc_pages_zone((RTL_RX_BUF_SIZE + 4095) / 4096, ZONE_DMA32);
     if (!rx_buf_virt) {
         kprintf("[NET] Failed to allocate RX buffer\n");
         return -1;
     }
-    rx_buf_phys = virt_to_phys(rx_buf_virt);
+    rx_buf_phys = (uint32_t)kvirt_to_phys(rx_buf_virt);
     /* zero it */
     for (uint32_t i = 0; i < RTL_RX_BUF_SIZE; i++) rx_buf_virt[i] = 0;
 
+    if (rx_softirq < 0) rx_softirq = softirq_register("net-rx", rtl8139_handle_rx, 0);
+    if (rx_softirq < 0) {
+        kprintf("[NET] Failed to register RX softirq\n");
+        return -1;
+    }
+
     /* Set RBSTART to physical address */
     outl_io(RTL_REG_RBSTART, rx_buf_phys);
 
@@ -129,17 +131,27 @@ int rtl8139_probe_init(void) {
 
     kprintf("[NET] RTL8139 init complete\n");
 
-    /* Unmask PIC for this IRQ: call your enable_irq() helper with irq_line */
-    enable_irq(irq_line);
-
-    /* Register IDT entry: you must add idt_set_entry(0x20 + irq_line, ...) from kernel_main after idt_init */
-    // Kernel: idt_set_entry(0x20 + irq_line, irqX_stub, 0x8E);
+    /* A dedicated MSI line when the card and the APIC allow it, else the
+       INTx line, which can be shared; the handler checks ISR to see if it was us */
+    uint8_t msi_line;
+    int registered;
+    if (pci_enable_msi(bus, slot, func, &msi_line, 1) == 1) {
+        irq_line = msi_line;
+        kprintf("[NET] Using MSI, IRQ line %u\n", irq_line);
+        registered = irq_register(irq_line, rtl8139_handle_irq, 0);
+    } else {
+        registered = irq_register_level(irq_line, rtl8139_handle_irq, 0);
+    }
+    if (registered != 0) {
+        kprintf("[NET] Failed to register IRQ %u\n", irq_line);
+        return -1;
+    }
 
     return 0;
 }
 
-/* read a packet from ring -- called when ROK interrupt occurs */
-static void rtl8139_handle_rx(void) {
+/* read a packet from ring -- softirq raised when ROK interrupt occurs */
+static void rtl8139_handle_rx(void *ctx) {
     uint16_t capr = inw_io(RTL_REG_CAPR); // Current Address of Packet Read (pointer to last processed)
     /* CAPR points to the last read position (offset) + 16? See spec: CAPR = current offset + 16 */
     /* Implementation: parse packets starting at rx_offset and update CAPR when done */
@@ -154,28 +166,10 @@ static void rtl8139_handle_rx(void) {
             // no more packets ready
             break;
         }
-        uint32_t pkt_start = read_offset + 4;
-        if (pkt_start + length > RTL_RX_BUF_SIZE) {
-            // wrap around handling: copy in two parts
-            uint32_t part = RTL_RX_BUF_SIZE - pkt_start;
-            // allocate temp or handle in two steps; simple approach: linearize into a small buffer
-            uint8_t tmp[1600];
-            uint32_t p = 0;
-            for (uint32_t i = 0; i < part; i++) tmp[p++] = buf[pkt_start + i];
-            for (uint32_t i = 0; i < length - part; i++) tmp[p++] = buf[i];
-            // hand off tmp, length
-            // for demonstration, print frame length
-            kprintf("[NET] RX pkt len=%u\n", length);
-            // TODO: parse Ethernet frame (e.g., IPv4/UDP)
-        } else {
-            // linear case
-            uint8_t *pkt = buf + pkt_start;
-            kprintf("[NET] RX pkt len=%u\n", length);
-            // For demo: print first few bytes hex
-            // for (int i=0;i< (length<16?length:16); i++) kprintf("%02x ", pkt[i]);
-            // kprintf("\n");
-            // TODO: process pkt
-        }
+        /* Nothing consumes frames yet, so none is copied out of the ring.
+           A protocol stack would take it here (it starts at read_offset + 4
+           and may wrap) into a buffer it owns */
+        kprintf("[NET] RX pkt len=%u\n", length);
 
         /* Advance read_offset: packet header + rounded length to dword? spec: length field is packet length incl CRC */
         uint32_t adv = ((length + 4 + 3) & ~3); // 4 byte header + data, rounded to dword
@@ -189,15 +183,18 @@ static void rtl8139_handle_rx(void) {
     rx_offset = read_offset;
 }
 
-/* This should be called by your IRQ stub for the NIC (which you assign to PCI IRQ) */
-void rtl8139_handle_irq(void) {
+/* Registered on the card's PCI interrupt line, which may be shared */
+int rtl8139_handle_irq(void *ctx) {
     uint16_t isr = inw_io(RTL_REG_ISR);
+    if (isr == 0) return IRQ_NONE;
     /* write back to clear */
     outw_io(RTL_REG_ISR, isr);
+    /* Only acknowledge here; the ring is drained with interrupts back on */
     if (isr & RL_ISR_ROK) {
-        rtl8139_handle_rx();
+        softirq_raise(rx_softirq);
     }
     if (isr & RL_ISR_TOK) {
         // handle transmit ok
     }
+    return IRQ_HANDLED;
 }
@@ -0,0 +1,93 @@
+// vmalloc.c
+#include "drivers/vmalloc.h"
+#include "drivers/vmregion.h"
+#include "drivers/paging.h"
+#include <stdint.h>
+
+typedef struct {
+    vm_region_t* region;    // 0 = slot unused
+    uint64_t size;
+    void* caller;
+} vmalloc_slot_t;
+
+static vmalloc_slot_t slots[VMALLOC_MAX];
+static vmalloc_stats_t stats;
+
+void* vmalloc(uint64_t size) {
+    stats.allocs++;
+    if (size == 0) return 0;
+
+    vmalloc_slot_t* slot = 0;
+    for (int i = 0; i < VMALLOC_MAX; i++) {
+        if (!slots[i].region) {
+            slot = &slots[i];
+            break;
+        }
+    }
+
+    vm_region_t* region = slot ? vm_region_reserve("vmalloc", size, PAGE_PRESENT | PAGE_RW) : 0;
+    if (!region) {
+        stats.failures++;
+        return 0;
+    }
+
+    // Back it all now: a caller of vmalloc expects failure here, not a
+    // fatal fault on some later access when frames run out
+    if (vm_region_populate(region) != 0) {
+        vm_region_release(region);
+        stats.failures++;
+        return 0;
+    }
+
+    slot->region = region;
+    slot->size = size;
+    slot->caller = __builtin_return_address(0);
+
+    stats.live++;
+    stats.bytes += size;
+    stats.pages += region->resident;
+    if (stats.pages > stats.peak_pages) stats.peak_pages = stats.pages;
+    return (void*)region->base;
+}
+
+void vfree(void* addr) {
+    if (!addr) return;
+
+    for (int i = 0; i < VMALLOC_MAX; i++) {
+        vmalloc_slot_t* slot = &slots[i];
+        if (!slot->region || slot->region->base != (uint64_t)addr) continue;
+
+        stats.live--;
+        stats.bytes -= slot->size;
+        stats.pages -= slot->region->resident;
+        stats.frees++;
+
+        vm_region_release(slot->region);
+        slot->region = 0;
+        return;
+    }
+}
+
+int vmalloc_get_info(int index, vmalloc_info_t* info) {
+    for (int i = 0; i < VMALLOC_MAX; i++) {
+        vmalloc_slot_t* slot = &slots[i];
+        if (!slot->region || index-- > 0) continue;
+
+        info->addr = (void*)slot->region->base;
+        info->size = slot->size;
+        info->pages = slot->region->resident;
+        info->caller = slot->caller;
+        return 0;
+    }
+    return -1;
+}
+
+void vmalloc_get_stats(vmalloc_stats_t* out) {
+    out->live = stats.live;
+    out->bytes = stats.bytes;
+    out->pages = stats.pages;
+    out->peak_pages = stats.peak_pages;
+    out->allocs = stats.allocs;
+    out->frees = stats.frees;
+    out->failures = stats.failures;
+}
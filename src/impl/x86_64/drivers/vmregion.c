@@ -0,0 +1,175 @@
+// vmregion.c
+#include "drivers/vmregion.h"
+#include "drivers/paging.h"
+#include "drivers/memory.h"
+#include "drivers/heap.h"
+#include "drivers/fat32.h"
+#include "lib/string.h"
+#include <stdint.h>
+
+#define PF_PRESENT 0x1  // Error code bit: protection violation, not a missing page
+
+static vm_region_t regions[VM_REGION_MAX];
+
+static uint64_t total_faults = 0;
+
+// Every region is followed by an unmapped guard page, so running off the
+// end of one faults instead of landing in the next
+static int range_is_free(uint64_t base, uint64_t span) {
+    if (base + span > VM_REGION_BASE + VM_REGION_SIZE) return 0;
+    for (int i = 0; i < VM_REGION_MAX; i++) {
+        vm_region_t* r = &regions[i];
+        if (r->base && base < r->base + r->size + PAGE_SIZE && r->base < base + span) return 0;
+    }
+    return 1;
+}
+
+// First fit: the window start or right behind some region's guard page
+static uint64_t find_range(uint64_t span) {
+    uint64_t best = 0;
+    if (range_is_free(VM_REGION_BASE, span)) return VM_REGION_BASE;
+    for (int i = 0; i < VM_REGION_MAX; i++) {
+        vm_region_t* r = &regions[i];
+        if (!r->base) continue;
+        uint64_t base = r->base + r->size + PAGE_SIZE;
+        if ((!best || base < best) && range_is_free(base, span)) best = base;
+    }
+    return best;
+}
+
+vm_region_t* vm_region_reserve(const char* name, uint64_t size, uint64_t flags) {
+    size = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (size == 0 || size > VM_REGION_SIZE - PAGE_SIZE) return 0;
+
+    for (int i = 0; i < VM_REGION_MAX; i++) {
+        vm_region_t* r = &regions[i];
+        if (r->base) continue;
+
+        uint64_t base = find_range(size + PAGE_SIZE);
+        if (!base) return 0;
+
+        r->name = name;
+        r->base = base;
+        r->size = size;
+        r->flags = flags | PAGE_PRESENT;
+        r->pager = 0;
+        r->pager_data = 0;
+        r->resident = 0;
+        r->faults = 0;
+        return r;
+    }
+    return 0;
+}
+
+void vm_region_attach(vm_region_t* region, vm_pager_t pager, void* data) {
+    region->pager = pager;
+    region->pager_data = data;
+}
+
+static int file_pager(vm_region_t* region, uint64_t offset, void* page) {
+    int n = fat32_read_file_at((const char*)region->pager_data, (uint32_t)offset,
+                               (uint8_t*)page, PAGE_SIZE);
+    if (n < 0) return -1;
+
+    // The tail of the last page, and anything past the file, reads as zero
+    uint8_t* p = (uint8_t*)page;
+    for (int i = n; i < PAGE_SIZE; i++) p[i] = 0;
+    return 0;
+}
+
+int vm_region_attach_file(vm_region_t* region, const char* path) {
+    if (!fat32_file_exists(path)) return -1;
+
+    uint64_t len = strlen(path);
+    char* copy = (char*)kmalloc(len + 1);
+    if (!copy) return -1;
+    kstrncpy(copy, path, len + 1);
+
+    vm_region_attach(region, file_pager, copy);
+    return 0;
+}
+
+// Give the page at addr a frame, filled by the region's pager
+static int fill_page(vm_region_t* region, uint64_t page) {
+    void* frame = alloc_frame();
+    if (!frame) return -1;
+
+    // Filled through the direct map before it becomes visible at page
+    void* data = phys_to_virt((uint64_t)frame);
+    if (region->pager) {
+        if (region->pager(region, page - region->base, data) != 0) {
+            free_frame(frame);
+            return -1;
+        }
+    } else {
+        uint64_t* p = (uint64_t*)data;
+        for (int i = 0; i < PAGE_SIZE / 8; i++) p[i] = 0;
+    }
+
+    if (map_page(page, (uint64_t)frame, region->flags) != 0) {
+        free_frame(frame);
+        return -1;
+    }
+    region->resident++;
+    return 0;
+}
+
+int vm_region_fault(uint64_t addr, uint64_t error) {
+    // Only missing pages are ours; a write to a read-only page is a bug
+    if (error & PF_PRESENT) return -1;
+
+    vm_region_t* region = 0;
+    for (int i = 0; i < VM_REGION_MAX; i++) {
+        vm_region_t* r = &regions[i];
+        if (r->base && addr >= r->base && addr < r->base + r->size) {
+            region = r;
+            break;
+        }
+    }
+    if (!region) return -1;
+
+    if (fill_page(region, addr & ~(uint64_t)(PAGE_SIZE - 1)) != 0) return -1;
+    region->faults++;
+    total_faults++;
+    return 0;
+}
+
+int vm_region_populate(vm_region_t* region) {
+    uint64_t end = region->base + region->size;
+    for (uint64_t page = region->base; page < end; page += PAGE_SIZE) {
+        if (paging_translate(page)) continue;
+        if (fill_page(region, page) != 0) return -1;
+    }
+    return 0;
+}
+
+void vm_region_discard(vm_region_t* region) {
+    uint64_t end = region->base + region->size;
+    for (uint64_t addr = region->base; addr < end && region->resident; addr += PAGE_SIZE) {
+        uint64_t frame = unmap_page(addr);
+        if (frame) {
+            free_frame((void*)frame);
+            region->resident--;
+        }
+    }
+}
+
+void vm_region_release(vm_region_t* region) {
+    vm_region_discard(region);
+    if (region->pager == file_pager) kfree(region->pager_data);
+    region->base = 0;
+}
+
+void vm_region_get_stats(vm_region_stats_t* stats) {
+    stats->regions = 0;
+    stats->reserved_pages = 0;
+    stats->resident_pages = 0;
+    for (int i = 0; i < VM_REGION_MAX; i++) {
+        vm_region_t* r = &regions[i];
+        if (!r->base) continue;
+        stats->regions++;
+        stats->reserved_pages += r->size / PAGE_SIZE;
+        stats->resident_pages += r->resident;
+    }
+    stats->faults = total_faults;
+}
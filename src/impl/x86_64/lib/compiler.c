@@ -3,7 +3,9 @@
 #include "lib/print.h"
 #include "lib/string.h"
 #include "drivers/heap.h"
+#include "drivers/arena.h"
 #include "drivers/fat32.h"
+#include "../lib/cpu.h"
 
 // ===== TOKENIZER =====
 
@@ -54,6 +56,8 @@ typedef struct {
     Token* tokens;
     int token_count;
     int token_capacity;
+    karena_t* arena;  // Token text
+    int out_of_memory;
 } Lexer;
 
 // ===== PARSER / AST =====
@@ -126,6 +130,8 @@ typedef struct {
     char** strings;
     int string_count;
     int string_capacity;
+
+    int out_of_memory;
 } CodeGen;
 
 // ===== VIRTUAL MACHINE =====
@@ -148,25 +154,31 @@ typedef struct {
 
 // ===== LEXER IMPLEMENTATION =====
 
-static void lexer_init(Lexer* lex, char* source) {
+static void lexer_init(Lexer* lex, char* source, karena_t* arena) {
     lex->source = source;
     lex->pos = 0;
     lex->line = 1;
     lex->col = 1;
+    lex->arena = arena;
     lex->token_count = 0;
     lex->token_capacity = 64;
     lex->tokens = (Token*)kmalloc(sizeof(Token) * lex->token_capacity);
+    lex->out_of_memory = !lex->tokens;
 }
 
+// Token text comes from the arena and the array from the heap; when either
+// runs out the lexer stops and out_of_memory makes the compile fail. On a
+// failed grow the old array stays, for compile_free, and the token is dropped
 static void add_token(Lexer* lex, TokenType type, char* value) {
+    if (lex->out_of_memory) return;
     if (lex->token_count >= lex->token_capacity) {
-        lex->token_capacity *= 2;
-        Token* new_tokens = (Token*)kmalloc(sizeof(Token) * lex->token_capacity);
-        for (int i = 0; i < lex->token_count; i++) {
-            new_tokens[i] = lex->tokens[i];
+        Token* tokens = (Token*)krealloc(lex->tokens, sizeof(Token) * lex->token_capacity * 2);
+        if (!tokens) {
+            lex->out_of_memory = 1;
+            return;
         }
-        kfree(lex->tokens);
-        lex->tokens = new_tokens;
+        lex->tokens = tokens;
+        lex->token_capacity *= 2;
     }
     
     lex->tokens[lex->token_count].type = type;
@@ -216,13 +228,9 @@ static char* extract_identifier(Lexer* lex) {
         lex->col++;
     }
     
-    int len = lex->pos - start;
-    char* id = (char*)kmalloc(len + 1);
-    for (int i = 0; i < len; i++) {
-        id[i] = lex->source[start + i];
-    }
-    id[len] = '\0';
-    return id;
+    char* text = karena_strndup(lex->arena, lex->source + start, lex->pos - start);
+    if (!text) lex->out_of_memory = 1;
+    return text;
 }
 
 static char* extract_number(Lexer* lex) {
@@ -232,13 +240,9 @@ static char* extract_number(Lexer* lex) {
         lex->col++;
     }
     
-    int len = lex->pos - start;
-    char* num = (char*)kmalloc(len + 1);
-    for (int i = 0; i < len; i++) {
-        num[i] = lex->source[start + i];
-    }
-    num[len] = '\0';
-    return num;
+    char* text = karena_strndup(lex->arena, lex->source + start, lex->pos - start);
+    if (!text) lex->out_of_memory = 1;
+    return text;
 }
 
 static char* extract_string(Lexer* lex) {
@@ -257,7 +261,11 @@ static char* extract_string(Lexer* lex) {
     }
     
     int len = lex->pos - start;
-    char* str = (char*)kmalloc(len + 1);
+    char* str = (char*)karena_alloc(lex->arena, len + 1);
+    if (!str) {
+        lex->out_of_memory = 1;
+        return NULL;
+    }
     int j = 0;
     for (int i = start; i < lex->pos; i++) {
         if (lex->source[i] == '\\' && lex->source[i+1] == 'n') {
@@ -279,7 +287,7 @@ static char* extract_string(Lexer* lex) {
 }
 
 static void tokenize(Lexer* lex) {
-    while (lex->source[lex->pos]) {
+    while (lex->source[lex->pos] && !lex->out_of_memory) {
         skip_whitespace(lex);
         if (!lex->source[lex->pos]) break;
         
@@ -342,18 +350,21 @@ static void tokenize(Lexer* lex) {
         // String literals
         else if (c == '"') {
             char* str = extract_string(lex);
+            if (!str) break;
             add_token(lex, TOK_STRING, str);
         }
         
         // Numbers
         else if (is_digit(c)) {
             char* num = extract_number(lex);
+            if (!num) break;
             add_token(lex, TOK_NUMBER, num);
         }
         
         // Keywords and identifiers
         else if (is_alpha(c)) {
             char* id = extract_identifier(lex);
+            if (!id) break;
             
             // Check for keywords
             if (strcmp(id, "int") == 0) add_token(lex, TOK_INT, id);
@@ -385,22 +396,25 @@ static void codegen_init(CodeGen* gen) {
     
     gen->var_count = 0;
     gen->var_capacity = 32;
-    gen->variables = (char**)kmalloc(sizeof(char*) * gen->var_capacity);
+    gen->variables = (char**)kcalloc(gen->var_capacity, sizeof(char*));
     
     gen->string_count = 0;
     gen->string_capacity = 32;
-    gen->strings = (char**)kmalloc(sizeof(char*) * gen->string_capacity);
+    gen->strings = (char**)kcalloc(gen->string_capacity, sizeof(char*));
+
+    gen->out_of_memory = !gen->instructions || !gen->variables || !gen->strings;
 }
 
 static void emit(CodeGen* gen, OpCode op, int operand) {
+    if (gen->out_of_memory) return;
     if (gen->count >= gen->capacity) {
-        gen->capacity *= 2;
-        Instruction* new_inst = (Instruction*)kmalloc(sizeof(Instruction) * gen->capacity);
-        for (int i = 0; i < gen->count; i++) {
-            new_inst[i] = gen->instructions[i];
+        Instruction* instructions = (Instruction*)krealloc(gen->instructions, sizeof(Instruction) * gen->capacity * 2);
+        if (!instructions) {
+            gen->out_of_memory = 1;
+            return;
         }
-        kfree(gen->instructions);
-        gen->instructions = new_inst;
+        gen->instructions = instructions;
+        gen->capacity *= 2;
     }
     
     gen->instructions[gen->count].op = op;
@@ -410,14 +424,15 @@ static void emit(CodeGen* gen, OpCode op, int operand) {
 }
 
 static int add_string(CodeGen* gen, char* str) {
+    if (gen->out_of_memory) return -1;
     if (gen->string_count >= gen->string_capacity) {
-        gen->string_capacity *= 2;
-        char** new_strs = (char**)kmalloc(sizeof(char*) * gen->string_capacity);
-        for (int i = 0; i < gen->string_count; i++) {
-            new_strs[i] = gen->strings[i];
+        char** strings = (char**)krealloc(gen->strings, sizeof(char*) * gen->string_capacity * 2);
+        if (!strings) {
+            gen->out_of_memory = 1;
+            return -1;
         }
-        kfree(gen->strings);
-        gen->strings = new_strs;
+        gen->strings = strings;
+        gen->string_capacity *= 2;
     }
     
     gen->strings[gen->string_count] = str;
@@ -478,10 +493,11 @@ static void generate_simple_code(CodeGen* gen, Token* tokens, int token_count) {
 
 // ===== VIRTUAL MACHINE =====
 
-static void vm_init(VM* vm, Instruction* code, int code_size, char** strings, int string_count) {
-    vm->stack = (int*)kmalloc(sizeof(int) * 256);
+// -1 if the arena has no room for the stack and locals
+static int vm_init(VM* vm, karena_t* arena, Instruction* code, int code_size, char** strings, int string_count) {
+    vm->stack = (int*)karena_alloc(arena, sizeof(int) * 256);
     vm->sp = 0;
-    vm->locals = (int*)kmalloc(sizeof(int) * 64);
+    vm->locals = (int*)karena_alloc(arena, sizeof(int) * 64);
     vm->local_count = 0;
     vm->code = code;
     vm->ip = 0;
@@ -489,6 +505,7 @@ static void vm_init(VM* vm, Instruction* code, int code_size, char** strings, in
     vm->strings = strings;
     vm->string_count = string_count;
     vm->running = 1;
+    return vm->stack && vm->locals ? 0 : -1;
 }
 
 static void vm_run(VM* vm) {
@@ -570,39 +587,69 @@ static void vm_run(VM* vm) {
 
 // ===== MAIN COMPILER INTERFACE =====
 
+// Tokenize and generate code; token text lives in the arena, the growable
+// arrays on the heap so they can be extended in place. -1 if the heap ran
+// out; compile_free still has to be called.
+static int compile_source(karena_t* arena, char* source, Lexer* lex, CodeGen* gen) {
+    lexer_init(lex, source, arena);
+    tokenize(lex);
+
+    codegen_init(gen);
+    if (!lex->out_of_memory) generate_simple_code(gen, lex->tokens, lex->token_count);
+    return lex->out_of_memory || gen->out_of_memory ? -1 : 0;
+}
+
+static void compile_free(Lexer* lex, CodeGen* gen) {
+    kfree(lex->tokens);
+    kfree(gen->instructions);
+    kfree(gen->variables);
+    kfree(gen->strings);
+}
+
 int compile_and_run(char* source) {
     print_info("Compiling C code...");
     
-    // Tokenize
+    const char* prev_tag = heap_prof_set_tag("compiler");
+
+    // Small compiler and VM objects come from one arena, freed in one go
+    karena_t* arena = karena_create(0);
+    if (!arena) {
+        print_error("Failed to allocate memory");
+        heap_prof_set_tag(prev_tag);
+        return -1;
+    }
+
     Lexer lex;
-    lexer_init(&lex, source);
-    tokenize(&lex);
-    
-    kprintf("Tokens: %d\n", lex.token_count);
-    
-    // Generate code
     CodeGen gen;
-    codegen_init(&gen);
-    generate_simple_code(&gen, lex.tokens, lex.token_count);
+    if (compile_source(arena, source, &lex, &gen) != 0) {
+        print_error("Compile error: out of memory");
+        compile_free(&lex, &gen);
+        karena_destroy(arena);
+        heap_prof_set_tag(prev_tag);
+        return -1;
+    }
     
+    kprintf("Tokens: %d\n", lex.token_count);
     kprintf("Instructions: %d\n", gen.count);
     print_success("Compilation complete");
     
     // Execute
     print_info("Executing program...");
     VM vm;
-    vm_init(&vm, gen.instructions, gen.count, gen.strings, gen.string_count);
+    if (vm_init(&vm, arena, gen.instructions, gen.count, gen.strings, gen.string_count) != 0) {
+        print_error("Execution failed: out of memory");
+        compile_free(&lex, &gen);
+        karena_destroy(arena);
+        heap_prof_set_tag(prev_tag);
+        return -1;
+    }
     vm_run(&vm);
     
     print_success("Execution complete");
     
-    // Cleanup
-    kfree(lex.tokens);
-    kfree(gen.instructions);
-    kfree(gen.variables);
-    kfree(vm.stack);
-    kfree(vm.locals);
-    
+    compile_free(&lex, &gen);
+    karena_destroy(arena);
+    heap_prof_set_tag(prev_tag);
     return 0;
 }
 
@@ -674,3 +721,87 @@ void cmd_compile(const char* args) {
     
     compile_file(filename);
 }
+
+// ===== BENCHMARK =====
+
+#define BENCH_STATEMENTS 64
+
+static const char bench_statement[] =
+    "    int value = 12345 + counter * 42;\n"
+    "    printf(\"hello from the compiler benchmark\\n\");\n";
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t heap_calls;
+    int failed;
+} compile_bench_t;
+
+static compile_bench_t bench_compile(char* source, uint32_t iterations, int pooled) {
+    compile_bench_t result = { 0, 0, 0 };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t calls = heap_get_calls();
+        uint64_t start = rdtsc();
+        karena_t* arena = pooled ? karena_create(0) : karena_create_unpooled();
+        if (!arena) {
+            result.failed = 1;
+            break;
+        }
+
+        Lexer lex;
+        CodeGen gen;
+        if (compile_source(arena, source, &lex, &gen) != 0) result.failed = 1;
+
+        compile_free(&lex, &gen);
+        karena_destroy(arena);
+        result.cycles += rdtsc() - start;
+        result.heap_calls += heap_get_calls() - calls;
+        if (result.failed) break;
+    }
+
+    return result;
+}
+
+void compiler_bench(uint32_t iterations) {
+    if (iterations == 0) iterations = 100;
+
+    // main() with BENCH_STATEMENTS copies of a statement that makes
+    // identifier, number and string tokens
+    const char* head = "int main() {\n";
+    const char* tail = "    return 0;\n}\n";
+    uint64_t stmt_len = sizeof(bench_statement) - 1;
+    uint64_t size = strlen(head) + BENCH_STATEMENTS * stmt_len + strlen(tail);
+
+    char* source = (char*)kmalloc(size + 1);
+    if (!source) {
+        print_error("compilebench: out of memory");
+        return;
+    }
+
+    char* p = source;
+    for (const char* c = head; *c; c++) *p++ = *c;
+    for (int i = 0; i < BENCH_STATEMENTS; i++) {
+        for (uint64_t j = 0; j < stmt_len; j++) *p++ = bench_statement[j];
+    }
+    for (const char* c = tail; *c; c++) *p++ = *c;
+    *p = '\0';
+
+    kprintf("Compiling a %u-statement program %u times...\n", BENCH_STATEMENTS, iterations);
+
+    compile_bench_t old_result = bench_compile(source, iterations, 0);
+    compile_bench_t new_result = bench_compile(source, iterations, 1);
+    kfree(source);
+    if (old_result.failed || new_result.failed) {
+        print_error("compilebench: out of memory");
+        return;
+    }
+
+    kprintf("per-object kmalloc (old): %lu cycles, %lu heap calls per compile\n",
+            old_result.cycles / iterations, old_result.heap_calls / iterations);
+    kprintf("arena              (new): %lu cycles, %lu heap calls per compile\n",
+            new_result.cycles / iterations, new_result.heap_calls / iterations);
+    if (new_result.cycles) {
+        uint64_t tenths = old_result.cycles * 10 / new_result.cycles;
+        kprintf("Speedup: %lu.%lux\n", tenths / 10, tenths % 10);
+    }
+}
\ No newline at end of file
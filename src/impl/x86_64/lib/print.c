@@ -1,4 +1,6 @@
 #include "lib/print.h"
+#include "drivers/paging.h"
+#include "drivers/vmregion.h"
 #include "ports.h"
 #include <stdarg.h>
 #include "lib/string.h"
@@ -43,8 +45,9 @@ static int scrollback_write_line = 0;
 static int scrollback_view_offset = 0;
 static int scrollback_total_lines = 0;
 static int scrollback_expanded = 0;
+static vm_region_t* scrollback_region = 0;  // Backs the expanded buffer
 
-struct Char* buffer = (struct Char*) 0xb8000;
+struct Char* buffer = (struct Char*) (DIRECT_MAP_BASE + VIDEO_MEMORY);
 size_t col = 0;
 size_t row = 0;
 uint8_t color = PRINT_COLOR_WHITE | (PRINT_COLOR_BLUE << 4);
@@ -61,6 +64,7 @@ void clear_row(int row) {
 
 // Initialize scrollback buffer
 void init_scrollback(void) {
+    // Cleared in place: the region stays resident, so printing never faults
     for (int i = 0; i < scrollback_capacity; i++) {
         for (int j = 0; j < VISIBLE_COLS; j++) {
             scrollback_buffer[i][j].character = ' ';
@@ -72,23 +76,39 @@ void init_scrollback(void) {
     scrollback_total_lines = 0;
 }
 
-// Expand scrollback buffer after heap is ready
-// Declare kmalloc if not already declared
-extern void* kmalloc(size_t size);
+// Pager for the scrollback region: pages start out as blank cells
+static int scrollback_fill(vm_region_t* region, uint64_t offset, void* page) {
+    struct Char blank = { .character = ' ', .color = color };
+    struct Char* cells = (struct Char*)page;
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(struct Char); i++) {
+        cells[i] = blank;
+    }
+    return 0;
+}
 
+// Expand scrollback buffer after paging is ready
 void expand_scrollback(void) {
     if (scrollback_expanded) {
         return;  // Already expanded
     }
     
-    // Allocate larger buffer from heap
+    // kprintf runs from IRQ and softirq context, which must not take a
+    // page fault into the frame allocator, so the region is backed up front
     size_t total_size = MAX_SCROLLBACK_LINES * VISIBLE_COLS * sizeof(struct Char);
-    struct Char (*new_buffer)[VISIBLE_COLS] = (struct Char (*)[VISIBLE_COLS])kmalloc(total_size);
+    scrollback_region = vm_region_reserve("scrollback", total_size, PAGE_PRESENT | PAGE_RW);
     
-    if (new_buffer == NULL) {
-        print_warning("Failed to expand scrollback buffer - kmalloc returned NULL");
+    if (scrollback_region == NULL) {
+        print_warning("Failed to expand scrollback buffer - no virtual region");
+        return;
+    }
+    vm_region_attach(scrollback_region, scrollback_fill, 0);
+    if (vm_region_populate(scrollback_region) != 0) {
+        vm_region_release(scrollback_region);
+        scrollback_region = NULL;
+        print_warning("Failed to expand scrollback buffer - out of memory");
         return;
     }
+    struct Char (*new_buffer)[VISIBLE_COLS] = (struct Char (*)[VISIBLE_COLS])scrollback_region->base;
     
     // Copy existing data from early buffer
     int lines_to_copy = (scrollback_total_lines < EARLY_SCROLLBACK_LINES) ? 
@@ -100,14 +120,6 @@ void expand_scrollback(void) {
         }
     }
     
-    // Initialize rest of new buffer
-    for (int i = lines_to_copy; i < MAX_SCROLLBACK_LINES; i++) {
-        for (int j = 0; j < VISIBLE_COLS; j++) {
-            new_buffer[i][j].character = ' ';
-            new_buffer[i][j].color = color;
-        }
-    }
-    
     // Switch to new buffer
     scrollback_buffer = new_buffer;
     scrollback_capacity = MAX_SCROLLBACK_LINES;
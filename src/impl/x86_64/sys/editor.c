@@ -4,6 +4,8 @@
 #include "lib/string.h"
 #include "drivers/fat32.h"
 #include "drivers/heap.h"
+#include "drivers/vmalloc.h"
+#include "sys/idle.h"
 
 #define MAX_LINES 100
 #define MAX_LINE_LENGTH 80
@@ -36,14 +38,15 @@ static int editor_load_file(const char* filename) {
         return 0;
     }
     
-    uint8_t* buffer = kmalloc(size + 1);
+    // The whole file at once, however fragmented the heap is
+    uint8_t* buffer = vmalloc(size + 1);
     if (!buffer) {
         return -1;
     }
     
     int bytes = fat32_read_file(filename, buffer, size);
     if (bytes < 0) {
-        kfree(buffer);
+        vfree(buffer);
         return -1;
     }
     
@@ -70,7 +73,7 @@ static int editor_load_file(const char* filename) {
         }
     }
     
-    kfree(buffer);
+    vfree(buffer);
     return 0;
 }
 
@@ -91,7 +94,7 @@ static int editor_save_file() {
         }
     }
     
-    uint8_t* buffer = kmalloc(total_size);
+    uint8_t* buffer = vmalloc(total_size);
     if (!buffer) {
         return -1;
     }
@@ -111,7 +114,7 @@ static int editor_save_file() {
     }
     
     int result = fat32_write_file(current_filename, buffer, total_size);
-    kfree(buffer);
+    vfree(buffer);
     
     return (result > 0) ? 0 : -1;
 }
@@ -166,6 +169,8 @@ void editor_open(const char* filename) {
     }
     current_filename[i] = '\0';
     
+    const char* prev_tag = heap_prof_set_tag("editor");
+
     // Load file
     editor_load_file(filename);
     current_line = 0;
@@ -176,7 +181,7 @@ void editor_open(const char* filename) {
     while (1) {
         char c = get_char();
         if (!c) {
-            __asm__ volatile("hlt");
+            cpu_idle();
             continue;
         }
         
@@ -185,6 +190,7 @@ void editor_open(const char* filename) {
             print_clear();
             print_info("Exiting editor");
             editor_free_lines();
+            heap_prof_set_tag(prev_tag);
             return;
         }
         
@@ -253,16 +259,14 @@ void editor_open(const char* filename) {
                     get_line(line_buffer, MAX_LINE_LENGTH);
                 }
                 
-                // Update line
-                if (lines[current_line]) {
-                    kfree(lines[current_line]);
-                }
+                // Update line, usually without moving it
                 int len = strlen(line_buffer);
-                lines[current_line] = kmalloc(len + 1);
-                if (lines[current_line]) {
+                char* updated = krealloc(lines[current_line], len + 1);
+                if (updated) {
                     for (int i = 0; i <= len; i++) {
-                        lines[current_line][i] = line_buffer[i];
+                        updated[i] = line_buffer[i];
                     }
+                    lines[current_line] = updated;
                 }
             }
             editor_display();
@@ -0,0 +1,170 @@
+// heapbench.c - compares the original first-fit heap with the block backend
+#include "sys/heapbench.h"
+#include "drivers/heap.h"
+#include "lib/print.h"
+#include "../lib/cpu.h"
+#include "../drivers/heap_internal.h"
+
+#define BENCH_SLOTS       128
+#define BENCH_ARENA_SIZE  (256 * 1024)
+
+// ===== LEGACY ALLOCATOR =====
+// The pre-boundary-tag allocator: one address-ordered list of every block,
+// first-fit allocation and a walk from the head on every free.
+
+typedef struct legacy_block {
+    uint64_t size;
+    uint8_t is_free;
+    struct legacy_block* next;
+} legacy_block_t;
+
+#define LEGACY_HEADER sizeof(legacy_block_t)
+
+static legacy_block_t* legacy_list;
+
+static void legacy_init(void* start, uint64_t size) {
+    legacy_list = (legacy_block_t*)start;
+    legacy_list->size = size - LEGACY_HEADER;
+    legacy_list->is_free = 1;
+    legacy_list->next = 0;
+}
+
+static void* legacy_alloc(uint64_t size) {
+    size = (size + 7) & ~7;
+
+    for (legacy_block_t* current = legacy_list; current; current = current->next) {
+        if (current->is_free && current->size >= size) {
+            if (current->size > size + LEGACY_HEADER + 64) {
+                legacy_block_t* new_block = (legacy_block_t*)((uint64_t)current + LEGACY_HEADER + size);
+                new_block->size = current->size - size - LEGACY_HEADER;
+                new_block->is_free = 1;
+                new_block->next = current->next;
+
+                current->size = size;
+                current->next = new_block;
+            }
+            current->is_free = 0;
+            return (void*)((uint64_t)current + LEGACY_HEADER);
+        }
+    }
+    return 0;
+}
+
+static void legacy_free(void* ptr) {
+    legacy_block_t* block = (legacy_block_t*)((uint64_t)ptr - LEGACY_HEADER);
+    block->is_free = 1;
+
+    if (block->next && block->next->is_free) {
+        block->size += LEGACY_HEADER + block->next->size;
+        block->next = block->next->next;
+    }
+
+    legacy_block_t* current = legacy_list;
+    while (current && current->next != block) {
+        current = current->next;
+    }
+
+    if (current && current->is_free &&
+        (uint64_t)current + LEGACY_HEADER + current->size == (uint64_t)block) {
+        current->size += LEGACY_HEADER + block->size;
+        current->next = block->next;
+    }
+}
+
+// ===== WORKLOAD =====
+
+typedef struct {
+    void* (*alloc)(uint64_t size);
+    void (*free)(void* ptr);
+} bench_ops_t;
+
+typedef struct {
+    uint64_t cycles;
+    uint32_t failures;
+} bench_result_t;
+
+static uint32_t bench_seed;
+
+static uint32_t bench_rand(void) {
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return (bench_seed >> 16) & 0x7FFF;
+}
+
+// Mostly small objects with the occasional multi-KB buffer, roughly the
+// mix the compiler, shell and FAT32 code produce
+static uint64_t bench_size(void) {
+    uint32_t r = bench_rand() % 100;
+    if (r < 75) return 16 + bench_rand() % 240;
+    if (r < 95) return 256 + bench_rand() % 1792;
+    return 2048 + bench_rand() % 6144;
+}
+
+// The backend on its own: kmalloc would send all but the largest requests
+// to the slabs. Blocks come from the live heap, which is not grown for them.
+static void bench_block_free(void* ptr) {
+    block_free(ptr);
+}
+
+static bench_result_t bench_workload(const bench_ops_t* ops, uint32_t count) {
+    void* slots[BENCH_SLOTS];
+    bench_result_t result = { 0, 0 };
+
+    for (int i = 0; i < BENCH_SLOTS; i++) slots[i] = 0;
+    bench_seed = 0xC0FFEE;
+
+    uint64_t start = rdtsc();
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t slot = bench_rand() % BENCH_SLOTS;
+        if (slots[slot]) {
+            ops->free(slots[slot]);
+            slots[slot] = 0;
+        } else {
+            slots[slot] = ops->alloc(bench_size());
+            if (!slots[slot]) result.failures++;
+        }
+    }
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        if (slots[i]) ops->free(slots[i]);
+    }
+    result.cycles = rdtsc() - start;
+
+    return result;
+}
+
+static void bench_report(const char* name, bench_result_t r, uint32_t ops) {
+    kprintf("%s %lu cycles total, %lu per op, %u failed\n",
+            name, r.cycles, r.cycles / ops, r.failures);
+}
+
+void heapbench_run(uint32_t ops) {
+    if (ops == 0) ops = 10000;
+
+    const char* prev_tag = heap_prof_set_tag("heapbench");
+    void* arena = kmalloc(BENCH_ARENA_SIZE);
+    heap_prof_set_tag(prev_tag);
+    if (!arena) {
+        print_error("heapbench: not enough heap for the legacy arena");
+        return;
+    }
+
+    kprintf("Running %u mixed alloc/free operations, backend %s...\n", ops, block_backend_name());
+
+    bench_ops_t legacy = { legacy_alloc, legacy_free };
+    bench_ops_t backend = { block_alloc, bench_block_free };
+    bench_ops_t front = { kmalloc, kfree };
+
+    legacy_init(arena, BENCH_ARENA_SIZE);
+    bench_result_t old_result = bench_workload(&legacy, ops);
+    bench_result_t new_result = bench_workload(&backend, ops);
+    bench_result_t slab_result = bench_workload(&front, ops);
+
+    kfree(arena);
+
+    bench_report("first-fit (old):", old_result, ops);
+    bench_report("backend   (new):", new_result, ops);
+    bench_report("kmalloc + slabs:", slab_result, ops);
+    if (new_result.cycles) {
+        uint64_t tenths = old_result.cycles * 10 / new_result.cycles;
+        kprintf("Speedup: %lu.%lux\n", tenths / 10, tenths % 10);
+    }
+}
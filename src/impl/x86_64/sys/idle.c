@@ -0,0 +1,13 @@
+#include "sys/idle.h"
+#include "drivers/paging.h"
+#include "core/softirq.h"
+
+// Pages zeroed per idle pass; small enough that a keypress arriving
+// meanwhile is picked up by the next timer tick at the latest
+#define IDLE_ZERO_BATCH 4
+
+void cpu_idle(void) {
+    softirq_run();      // Whatever IRQ exits left over
+    paging_prezero_tables(IDLE_ZERO_BATCH);
+    __asm__ volatile("hlt");
+}
@@ -1,11 +1,11 @@
 #include "sys/script.h"
 #include "lib/print.h"
 #include "drivers/fat32.h"
-#include "drivers/heap.h"
+#include "drivers/vmalloc.h"
 #include "lib/string.h"
 #include "sys/shell.h"
 
-#define MAX_SCRIPT_SIZE 4096
+#define MAX_SCRIPT_SIZE (1024 * 1024)
 #define MAX_LINE_LENGTH 256
 #define MAX_VARIABLES 16
 #define MAX_VAR_NAME 32
@@ -186,7 +186,8 @@ int script_run(const char* filename) {
         return -1;
     }
     
-    uint8_t* script_data = kmalloc(size + 1);
+    // Virtually contiguous, so a big script needs no big run of free heap
+    uint8_t* script_data = vmalloc(size + 1);
     if (!script_data) {
         print_error("Out of memory");
         return -1;
@@ -195,7 +196,7 @@ int script_run(const char* filename) {
     int bytes = fat32_read_file(filename, script_data, size);
     if (bytes < 0) {
         print_error("Failed to read script");
-        kfree(script_data);
+        vfree(script_data);
         return -1;
     }
     
@@ -226,6 +227,6 @@ int script_run(const char* filename) {
         }
     }
     
-    kfree(script_data);
+    vfree(script_data);
     return 0;
 }
@@ -4,14 +4,23 @@
 #include "lib/string.h"
 #include "drivers/fat32.h"
 #include "drivers/memory.h"
+#include "drivers/paging.h"
+#include "drivers/vmregion.h"
+#include "drivers/vmalloc.h"
 #include "drivers/timer.h"
 #include "drivers/heap.h"
+#include "drivers/kmem_cache.h"
 #include "sys/editor.h"
 #include "drivers/ata.h"
 #include "lib/string_utils.h"
 #include "sys/system.h"
 #include "sys/script.h"
 #include "lib/compiler.h"
+#include "sys/heapbench.h"
+#include "sys/tlbbench.h"
+#include "sys/irqbench.h"
+#include "core/softirq.h"
+#include "core/irq.h"
 
 #define MAX_TEST_ALLOCS 16
 static void *test_allocs[MAX_TEST_ALLOCS];
@@ -21,18 +30,25 @@ static int test_alloc_count = 0;
 static void cmd_help(void);
 static void cmd_ls(void);
 static void cmd_cat(const char *filename);
+static void cmd_heapprof(const char *args);
+static void cmd_vmallocinfo(void);
+static void cmd_softirqs(void);
+static void cmd_irqstat(const char *args);
 int shell_execute_command(const char* line);
 
 void shell_run(void)
 {
     char line[128];
 
+    heap_prof_set_tag("shell");
+
     while (1)
     {
         char cwd[256];
         fat32_get_current_directory(cwd, sizeof(cwd));
         kprintf("%s\n", cwd);
         print_prompt("> ");
+        heap_trim();    // Waiting for input anyway, hand back idle heap pages
         get_line(line, sizeof(line));
         shell_execute_command(line);
         print_newLine();
@@ -65,6 +81,15 @@ static void cmd_help(void)
     print_str("clear    - clear screen\n");
     print_str("uptime   - show uptime\n");
     print_str("meminfo  - show memory stats\n");
+    print_str("heapbench [n] - compare old and new heap allocators\n");
+    print_str("compilebench [n] - compare compiler memory with and without an arena\n");
+    print_str("tlbbench [mb] - compare TLB misses with 4 KB and 2 MB pages\n");
+    print_str("switchbench [n] - address space switch cost: flush, global pages, PCID\n");
+    print_str("irqbench [n] - interrupt entry latency and EOI cost\n");
+    print_str("heapprof [on|off] - heap allocation profile by call site\n");
+    print_str("vmallocinfo - list vmalloc buffers\n");
+    print_str("softirqs - deferred interrupt work per source\n");
+    print_str("irqstat [on|off|reset] - interrupt counts, handler cycles, storms\n");
     print_str("reboot   - reboot system\n");
 }
 
@@ -100,6 +125,9 @@ static void cmd_ls(void)
     }
 }
 
+// cat reads the whole file into one vmalloc buffer
+#define CAT_MAX_SIZE (1024 * 1024)
+
 static void cmd_cat(const char *filename)
 {
     if (!fat32_file_exists(filename))
@@ -114,13 +142,13 @@ static void cmd_cat(const char *filename)
         {
             print_str("Empty file\n");
         }
-        else if (size > 4096)
+        else if (size > CAT_MAX_SIZE)
         {
-            print_str("File too large (max 4KB for display)\n");
+            print_str("File too large (max 1MB for display)\n");
         }
         else
         {
-            uint8_t *buffer = kmalloc(size + 1);
+            uint8_t *buffer = vmalloc(size + 1);
             if (!buffer)
             {
                 print_str("Out of memory\n");
@@ -139,12 +167,159 @@ static void cmd_cat(const char *filename)
                     print_str((char *)buffer);
                     print_str("\n=== End ===\n");
                 }
-                kfree(buffer);
+                vfree(buffer);
             }
         }
     }
 }
 
+static void print_prof_sites(heap_prof_site_t *sites, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (sites[i].site)
+            kprintf("  0x%lx %s: %lu bytes in %lu blocks\n",
+                    (uint64_t)sites[i].site, sites[i].tag, sites[i].bytes, sites[i].count);
+        else
+            kprintf("  %s: %lu bytes in %lu blocks\n",
+                    sites[i].tag, sites[i].bytes, sites[i].count);
+    }
+}
+
+static void cmd_heapprof(const char *args)
+{
+    if (strcmp(args, "on") == 0)
+    {
+        if (heap_prof_enable(1) != 0)
+            print_str("Not enough memory for the profile table\n");
+        else
+            print_str("Heap profiling on; blocks allocated from now on are tracked\n");
+        return;
+    }
+    if (strcmp(args, "off") == 0)
+    {
+        heap_prof_enable(0);
+        print_str("Heap profiling off\n");
+        return;
+    }
+    if (!heap_prof_enabled())
+    {
+        print_str("Heap profiling is off, use 'heapprof on'\n");
+        return;
+    }
+
+    heap_prof_site_t sites[5];
+    int n;
+
+    print_str("=== Heap Profile ===\n");
+    kprintf("Fragmentation: %lu%% (largest free block %lu bytes)\n",
+            heap_get_fragmentation(), heap_get_largest_free());
+    if (heap_prof_dropped())
+        kprintf("Not tracked:   %lu blocks (table full)\n", heap_prof_dropped());
+
+    print_str("Top sites by bytes:\n");
+    n = heap_prof_top_sites(sites, 5, HEAP_PROF_SORT_BYTES);
+    print_prof_sites(sites, n);
+
+    print_str("Top sites by count:\n");
+    n = heap_prof_top_sites(sites, 5, HEAP_PROF_SORT_COUNT);
+    print_prof_sites(sites, n);
+
+    print_str("By subsystem:\n");
+    n = heap_prof_top_tags(sites, 5);
+    print_prof_sites(sites, n);
+
+    uint64_t counts[HEAP_PROF_HIST_BUCKETS];
+    uint64_t bytes[HEAP_PROF_HIST_BUCKETS];
+    heap_prof_histogram(counts, bytes);
+
+    print_str("Live blocks by size:\n");
+    for (int b = 0; b < HEAP_PROF_HIST_BUCKETS; b++)
+    {
+        if (counts[b] == 0)
+            continue;
+        if (b == HEAP_PROF_HIST_BUCKETS - 1)
+            kprintf("  >  %lu B: %lu blocks, %lu bytes\n", 16UL << (b - 1), counts[b], bytes[b]);
+        else
+            kprintf("  <= %lu B: %lu blocks, %lu bytes\n", 16UL << b, counts[b], bytes[b]);
+    }
+}
+
+static void cmd_irqstat(const char *args)
+{
+    if (strcmp(args, "on") == 0)
+    {
+        irq_set_sampling(1);
+        print_str("IRQ handler timing on\n");
+        return;
+    }
+    if (strcmp(args, "off") == 0)
+    {
+        irq_set_sampling(0);
+        print_str("IRQ handler timing off\n");
+        return;
+    }
+    if (strcmp(args, "reset") == 0)
+    {
+        irq_reset_stats();
+        print_str("IRQ statistics cleared\n");
+        return;
+    }
+
+    print_str("=== IRQ Statistics ===\n");
+    kprintf("Controller: %s, handler timing %s\n", irq_get_chip()->name,
+            irq_get_sampling() ? "on" : "off (irqstat on)");
+
+    irq_stats_t st;
+    for (uint32_t i = 0; irq_get_stats(i, &st) == 0; i++)
+    {
+        if (st.count == 0 && st.spurious == 0 && st.handlers == 0)
+            continue;
+
+        kprintf("  vec 0x%x line %u: %lu irqs, %lu unhandled, %lu spurious, %u handlers",
+                IRQ_BASE_VECTOR + i, i, st.count, st.unhandled, st.spurious, st.handlers);
+        if (st.samples)
+            kprintf(", %lu/%lu/%lu cycles min/avg/max",
+                    st.cycles_min, st.cycles_total / st.samples, st.cycles_max);
+        if (st.storms)
+            kprintf(", %lu storms%s", st.storms, st.storming ? " (STORM)" : "");
+        print_str("\n");
+    }
+}
+
+static void cmd_softirqs(void)
+{
+    print_str("=== softirqs ===\n");
+    kprintf("Pending: %s, %lu IRQ exits left work for idle\n",
+            softirq_pending() ? "yes" : "no", softirq_get_deferred());
+
+    softirq_info_t info;
+    for (int i = 0; softirq_get_info(i, &info) == 0; i++)
+    {
+        uint64_t avg = info.runs ? info.cycles / info.runs : 0;
+        kprintf("  %s: raised %lu, ran %lu, avg %lu cycles, max %lu cycles\n",
+                info.name, info.raised, info.runs, avg, info.max_cycles);
+    }
+}
+
+static void cmd_vmallocinfo(void)
+{
+    vmalloc_stats_t st;
+    vmalloc_get_stats(&st);
+
+    print_str("=== vmalloc ===\n");
+    kprintf("Live:     %lu buffers, %lu bytes in %lu pages (peak %lu pages)\n",
+            st.live, st.bytes, st.pages, st.peak_pages);
+    kprintf("Calls:    %lu allocs, %lu frees, %lu failed\n", st.allocs, st.frees, st.failures);
+
+    vmalloc_info_t info;
+    for (int i = 0; vmalloc_get_info(i, &info) == 0; i++)
+    {
+        kprintf("  0x%lx %lu bytes, %lu pages + guard, from 0x%lx\n",
+                (uint64_t)info.addr, info.size, info.pages, (uint64_t)info.caller);
+    }
+}
+
 int shell_execute_command(const char* line) {
     if (strcmp(line, "help") == 0)
     {
@@ -204,7 +379,7 @@ int shell_execute_command(const char* line) {
             {
                 test_allocs[test_alloc_count] = ptr;
                 test_alloc_sizes[test_alloc_count] = size;
-                kprintf("Allocated %d bytes at 0x%x [slot %d]\n",
+                kprintf("Allocated %d bytes at 0x%lx [slot %d]\n",
                         size, ptr, test_alloc_count);
                 test_alloc_count++;
             }
@@ -223,7 +398,7 @@ int shell_execute_command(const char* line) {
         else
         {
             test_alloc_count--;
-            kprintf("Freeing 0x%x [slot %d]\n",
+            kprintf("Freeing 0x%lx [slot %d]\n",
                     test_allocs[test_alloc_count], test_alloc_count);
             kfree(test_allocs[test_alloc_count]);
             test_allocs[test_alloc_count] = 0;
@@ -242,7 +417,7 @@ int shell_execute_command(const char* line) {
         }
         else
         {
-            kprintf("Freeing 0x%x [slot %d]\n", test_allocs[idx], idx);
+            kprintf("Freeing 0x%lx [slot %d]\n", test_allocs[idx], idx);
             kfree(test_allocs[idx]);
             test_allocs[idx] = 0;
         }
@@ -254,7 +429,7 @@ int shell_execute_command(const char* line) {
         {
             if (test_allocs[i])
             {
-                kprintf("[%d] 0x%x (%d bytes)\n",
+                kprintf("[%d] 0x%lx (%d bytes)\n",
                         i, test_allocs[i], test_alloc_sizes[i]);
             }
             else
@@ -276,6 +451,122 @@ int shell_execute_command(const char* line) {
         kprintf("Free:        %d bytes (%d KB)\n", free, free / 1024);
         kprintf("Allocations: %d active\n", allocs);
         kprintf("Test slots:  %d/%d used\n", test_alloc_count, MAX_TEST_ALLOCS);
+        kprintf("Backend:     %s\n", heap_get_backend());
+        kprintf("Largest:     %lu bytes free in one block\n", heap_get_largest_free());
+        kprintf("Fragmented:  %lu%%\n", heap_get_fragmentation());
+        kprintf("Limit:       %lu KB, grown %lu times, %lu pages trimmed\n",
+                heap_get_limit() / 1024, heap_get_grows(), heap_get_trimmed_pages());
+        kprintf("Large:       %lu objects in %lu pages\n",
+                heap_get_large_objects(), heap_get_large_pages());
+        kprintf("Realloc:     %lu in place, %lu moved\n",
+                heap_get_realloc_in_place(), heap_get_realloc_moved());
+        kprintf("Frames:      %lu KB free of %lu KB physical\n",
+                get_free_memory() / 1024, get_total_memory() / 1024);
+
+        paging_stats_t ps;
+        paging_get_stats(&ps);
+        kprintf("Paging:      %lu tables (%lu freed), %lu 4K / %lu 2M / %lu 1G pages\n",
+                ps.tables, ps.tables_freed, ps.pages_4kb, ps.pages_2mb, ps.pages_1gb);
+        kprintf("TLB flushes: %lu invlpg, %lu full\n", ps.invlpg, ps.full_flushes);
+        kprintf("TLB:         global pages %s, PCID %s, INVPCID %s\n",
+                ps.global_pages ? "on" : "off", ps.pcid ? "on" : "off",
+                ps.invpcid ? "yes" : "no");
+
+        uint64_t pooled, zero_hits, zero_misses;
+        paging_get_zero_stats(&pooled, &zero_hits, &zero_misses);
+        uint64_t zero_total = zero_hits + zero_misses;
+        kprintf("Zero pool:   %lu tables ready, %lu hits, %lu misses (%lu%% hit)\n",
+                pooled, zero_hits, zero_misses,
+                zero_total ? zero_hits * 100 / zero_total : 0);
+
+        vm_region_stats_t vs;
+        vm_region_get_stats(&vs);
+        kprintf("Regions:     %lu reserved, %lu of %lu pages resident, %lu faults\n",
+                vs.regions, vs.resident_pages, vs.reserved_pages, vs.faults);
+
+        print_str("\n=== Slab Classes ===\n");
+        for (int i = 0; i < HEAP_SLAB_CLASSES; i++)
+        {
+            heap_slab_stats_t st;
+            if (heap_get_slab_stats(i, &st) != 0)
+                continue;
+            kprintf("%lu B: live %lu, slabs %lu, hits %lu, misses %lu\n",
+                    st.object_size, st.live, st.slabs, st.hits, st.misses);
+        }
+
+        print_str("\n=== Object Caches ===\n");
+        for (int i = 0; i < KMEM_MAX_CACHES; i++)
+        {
+            kmem_cache_stats_t cs;
+            if (kmem_cache_get_stats(i, &cs) != 0)
+                continue;
+            kprintf("%s (%lu B): live %lu, free %lu, slabs %lu, allocs %lu, ctors %lu\n",
+                    cs.name, cs.object_size, cs.live, cs.free_objects, cs.slabs,
+                    cs.allocs, cs.ctor_calls);
+        }
+
+        print_str("\n=== Physical Memory ===\n");
+        for (int z = 0; z < MEMORY_ZONES; z++)
+        {
+            memory_zone_stats_t zs;
+            if (memory_get_zone_stats(z, &zs) != 0 || zs.present_pages == 0)
+                continue;
+            kprintf("%s: %lu KB free of %lu KB, watermark %lu KB, %lu fallbacks\n",
+                    zs.name, zs.free_pages * 4, zs.present_pages * 4,
+                    zs.watermark * 4, zs.fallbacks);
+        }
+        for (int order = 0; order < MEMORY_ORDERS; order++)
+        {
+            uint64_t blocks = get_free_blocks(order);
+            if (blocks == 0)
+                continue;
+            uint64_t kb = (PAGE_SIZE / 1024) << order;
+            if (kb >= 1024)
+                kprintf("Order %d (%lu MB): %lu free\n", order, kb / 1024, blocks);
+            else
+                kprintf("Order %d (%lu KB): %lu free\n", order, kb, blocks);
+        }
+    }
+    else if (strcmp(line, "heapbench") == 0 || strncmp(line, "heapbench ", 10) == 0)
+    {
+        uint32_t ops = (line[9] == ' ') ? kstr_to_uint32(line + 10) : 0;
+        heapbench_run(ops);
+    }
+    else if (strcmp(line, "heapprof") == 0 || strncmp(line, "heapprof ", 9) == 0)
+    {
+        cmd_heapprof(line[8] == ' ' ? line + 9 : "");
+    }
+    else if (strcmp(line, "vmallocinfo") == 0)
+    {
+        cmd_vmallocinfo();
+    }
+    else if (strcmp(line, "softirqs") == 0)
+    {
+        cmd_softirqs();
+    }
+    else if (strcmp(line, "irqstat") == 0 || strncmp(line, "irqstat ", 8) == 0)
+    {
+        cmd_irqstat(line[7] == ' ' ? line + 8 : "");
+    }
+    else if (strcmp(line, "tlbbench") == 0 || strncmp(line, "tlbbench ", 9) == 0)
+    {
+        uint32_t mb = (line[8] == ' ') ? kstr_to_uint32(line + 9) : 0;
+        tlbbench_run(mb);
+    }
+    else if (strcmp(line, "switchbench") == 0 || strncmp(line, "switchbench ", 12) == 0)
+    {
+        uint32_t rounds = (line[11] == ' ') ? kstr_to_uint32(line + 12) : 0;
+        tlbbench_switch_run(rounds);
+    }
+    else if (strcmp(line, "irqbench") == 0 || strncmp(line, "irqbench ", 9) == 0)
+    {
+        uint32_t rounds = (line[8] == ' ') ? kstr_to_uint32(line + 9) : 0;
+        irqbench_run(rounds);
+    }
+    else if (strcmp(line, "compilebench") == 0 || strncmp(line, "compilebench ", 13) == 0)
+    {
+        uint32_t iterations = (line[12] == ' ') ? kstr_to_uint32(line + 13) : 0;
+        compiler_bench(iterations);
     }
     else if (strncmp(line, "sleep ", 6) == 0)
     {
@@ -0,0 +1,204 @@
+// tlbbench.c - TLB reach of 4 KB pages versus 2 MB pages
+#include "sys/tlbbench.h"
+#include "drivers/memory.h"
+#include "drivers/paging.h"
+#include "lib/print.h"
+#include "../lib/cpu.h"
+
+// Unused, 1 GB aligned stretch of the address space for the test mapping
+#define BENCH_VIRT   0xFFFF900000000000ULL
+#define BENCH_ROUNDS 8
+#define HUGE_BYTES   (2 * 1024 * 1024)
+#define SWITCH_PAGES 256    // Working set touched after every address space switch
+#define SWITCH_PCID  1      // Tag for the cloned space; the kernel's is 0
+
+typedef struct {
+    uint64_t entries;       // Leaf entries (TLB entries) covering the buffer
+    uint64_t tables;        // Page tables in use while it was mapped
+    uint64_t map_cycles;
+    uint64_t access_cycles;
+} tlb_result_t;
+
+// Visit every page once per round in a scattered order (an odd stride
+// modulo a power of two hits each page), so neither the prefetcher nor
+// a small TLB working set hides the walks
+static uint64_t touch_pages(uint64_t pages) {
+    volatile uint64_t sum = 0;
+    uint64_t start = rdtsc();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint64_t page = round;
+        for (uint64_t i = 0; i < pages; i++) {
+            page = (page + 2654435761ULL) & (pages - 1);
+            sum += *(volatile uint64_t*)(BENCH_VIRT + page * PAGE_SIZE + (i & 63) * 64);
+        }
+    }
+    (void)sum;
+    return rdtsc() - start;
+}
+
+static uint64_t leaf_entries(paging_stats_t* s) {
+    return s->pages_4kb + s->pages_2mb + s->pages_1gb;
+}
+
+// -1 if the mapping could not be built; whatever part was is removed again
+static int bench_mapping(uint64_t phys, uint64_t pages, int huge, tlb_result_t* r) {
+    paging_stats_t before, after;
+    int err = 0;
+
+    paging_get_stats(&before);
+    uint64_t start = rdtsc();
+    if (huge) {
+        err = map_range(BENCH_VIRT, phys, pages * PAGE_SIZE, PAGE_PRESENT | PAGE_RW);
+    } else {
+        for (uint64_t i = 0; i < pages && !err; i++) {
+            err = map_page(BENCH_VIRT + i * PAGE_SIZE, phys + i * PAGE_SIZE, PAGE_PRESENT | PAGE_RW);
+        }
+    }
+    r->map_cycles = rdtsc() - start;
+    if (err) {
+        unmap_range(BENCH_VIRT, pages * PAGE_SIZE);
+        return -1;
+    }
+    paging_get_stats(&after);
+    r->entries = leaf_entries(&after) - leaf_entries(&before);
+    r->tables = after.tables;
+
+    touch_pages(pages);     // Warm up caches so only translation differs
+    r->access_cycles = touch_pages(pages);
+
+    unmap_range(BENCH_VIRT, pages * PAGE_SIZE);
+    return 0;
+}
+
+static void bench_report(const char* name, tlb_result_t r, uint64_t accesses) {
+    kprintf("%s %lu entries, %lu tables in use, map %lu cycles, %lu cycles per access\n",
+            name, r.entries, r.tables, r.map_cycles, r.access_cycles / accesses);
+}
+
+void tlbbench_run(uint32_t mb) {
+    if (mb == 0) mb = 16;
+
+    // Power of two number of 2 MB pages, for the stride and for map_range
+    uint64_t bytes = HUGE_BYTES;
+    while (bytes < (uint64_t)mb * 1024 * 1024) bytes <<= 1;
+    uint64_t pages = bytes / PAGE_SIZE;
+
+    uint64_t phys = (uint64_t)alloc_frames(pages, HUGE_BYTES);
+    if (!phys) {
+        print_error("tlbbench: no contiguous 2 MB aligned run that large");
+        return;
+    }
+
+    kprintf("Touching %lu pages (%lu MB), %u rounds...\n", pages, bytes >> 20, BENCH_ROUNDS);
+    uint64_t accesses = pages * BENCH_ROUNDS;
+
+    tlb_result_t small, huge;
+    int err = bench_mapping(phys, pages, 0, &small);
+    if (!err) err = bench_mapping(phys, pages, 1, &huge);
+
+    free_frames((void*)phys, pages);
+    if (err) {
+        print_error("tlbbench: out of page tables");
+        return;
+    }
+
+    bench_report("4 KB pages:", small, accesses);
+    bench_report("2 MB pages:", huge, accesses);
+    if (huge.access_cycles) {
+        uint64_t tenths = small.access_cycles * 10 / huge.access_cycles;
+        kprintf("Speedup: %lu.%lux\n", tenths / 10, tenths % 10);
+    }
+}
+
+// One read per page of the switch working set
+static void touch_switch_set() {
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < SWITCH_PAGES; i++) {
+        sum += *(volatile uint64_t*)(BENCH_VIRT + i * PAGE_SIZE);
+    }
+    (void)sum;
+}
+
+// Bounce between the kernel space and its clone, touching the working set
+// after each switch, and return cycles per switch (touch included)
+static uint64_t bench_switch(uint64_t kernel, uint64_t clone, uint32_t rounds, int tagged) {
+    uint16_t pcid = tagged ? SWITCH_PCID : 0;
+
+    // Prime both tags
+    paging_switch(clone, pcid, 0);
+    touch_switch_set();
+    paging_switch(kernel, 0, tagged);
+    touch_switch_set();
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < rounds; i++) {
+        paging_switch(clone, pcid, tagged);
+        touch_switch_set();
+        paging_switch(kernel, 0, tagged);
+        touch_switch_set();
+    }
+    return (rdtsc() - start) / ((uint64_t)rounds * 2);
+}
+
+void tlbbench_switch_run(uint32_t rounds) {
+    if (rounds == 0) rounds = 10000;
+
+    paging_stats_t ps;
+    paging_get_stats(&ps);
+    int had_global = ps.global_pages;
+
+    uint64_t phys = (uint64_t)alloc_frames(SWITCH_PAGES, PAGE_SIZE);
+    if (!phys) {
+        print_error("switchbench: out of memory");
+        return;
+    }
+    for (uint64_t i = 0; i < SWITCH_PAGES; i++) {
+        if (map_page(BENCH_VIRT + i * PAGE_SIZE, phys + i * PAGE_SIZE, PAGE_PRESENT | PAGE_RW) != 0) {
+            print_error("switchbench: out of page tables");
+            unmap_range(BENCH_VIRT, SWITCH_PAGES * PAGE_SIZE);
+            free_frames((void*)phys, SWITCH_PAGES);
+            return;
+        }
+    }
+
+    // Cloned after the mapping, so both spaces see the working set
+    uint64_t kernel = paging_kernel_space();
+    uint64_t clone = paging_clone_space();
+    if (!clone) {
+        print_error("switchbench: out of page tables");
+        unmap_range(BENCH_VIRT, SWITCH_PAGES * PAGE_SIZE);
+        free_frames((void*)phys, SWITCH_PAGES);
+        return;
+    }
+
+    kprintf("%u round trips, %u pages touched after each switch\n", rounds, SWITCH_PAGES);
+
+    asm volatile("cli");
+    paging_set_global(0);
+    uint64_t flush = bench_switch(kernel, clone, rounds, 0);
+    paging_set_global(1);
+    uint64_t global = bench_switch(kernel, clone, rounds, 0);
+    uint64_t tagged = 0;
+    if (ps.pcid) {
+        paging_set_global(0);
+        tagged = bench_switch(kernel, clone, rounds, 1);
+    }
+    paging_set_global(had_global);
+    asm volatile("sti");
+
+    paging_release_space(clone, SWITCH_PCID);
+    unmap_range(BENCH_VIRT, SWITCH_PAGES * PAGE_SIZE);
+    free_frames((void*)phys, SWITCH_PAGES);
+
+    kprintf("Full flush:   %lu cycles per switch\n", flush);
+    if (had_global) {
+        kprintf("Global pages: %lu cycles per switch\n", global);
+    } else {
+        kprintf("Global pages: not supported\n");
+    }
+    if (ps.pcid) {
+        kprintf("PCID tagged:  %lu cycles per switch\n", tagged);
+    } else {
+        kprintf("PCID tagged:  not supported\n");
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+// Hardware interrupts. Line n arrives on vector IRQ_BASE_VECTOR + n, each
+// through its own small stub in irq.asm that passes n to irq_dispatch.
+// Lines 0-15 are the legacy PIC inputs.
+#define IRQ_BASE_VECTOR 0x20
+#define IRQ_LINES       224     // Vectors 0x20-0xFF; must match irq.asm
+#define IRQ_ACTIONS_MAX 32      // Handlers registered at once, all lines together
+#define IRQ_DYNAMIC_FIRST 32    // irq_alloc_lines (MSI) starts here, or past the controller's last line
+#define IRQ_STORM_RATE  10000   // Interrupts per second on one line that count as a storm
+
+// Handler return values. Every handler on a shared line runs; each one
+// checks its own device and says whether the interrupt was its
+#define IRQ_NONE    0
+#define IRQ_HANDLED 1
+
+// How the device drives its line. ISA devices are edge triggered, active
+// high; PCI INTx is level triggered, active low. A MADT source override for
+// an ISA line wins over either.
+#define IRQ_TRIGGER_EDGE  0
+#define IRQ_TRIGGER_LEVEL 1
+
+// Runs with interrupts off, before the line is acknowledged. Anything
+// slow belongs in a softirq (core/softirq.h) raised from here.
+typedef int (*irq_handler_t)(void* ctx);
+
+// The interrupt controller behind the lines: the 8259 pair at boot, the
+// I/O APIC and local APIC once apic_init finds them
+typedef struct {
+    const char* name;
+    uint32_t lines;                 // Lines it can mask; EOI covers all of them
+    void (*unmask)(uint8_t line, int trigger);
+    void (*mask)(uint8_t line);
+    void (*eoi)(uint8_t line);
+    int (*spurious)(uint8_t line);  // 1 = nothing to run and no EOI to send
+} irq_chip_t;
+
+void irq_init();    // Point every IRQ vector at its stub
+void irq_set_chip(const irq_chip_t* chip);  // Moves every registered line over
+const irq_chip_t* irq_get_chip();
+int irq_alloc_lines(uint32_t count);          // count free lines, aligned to count (a power of two); -1 if none
+void irq_free_lines(uint8_t first, uint32_t count);
+int irq_register(uint8_t line, irq_handler_t handler, void* ctx);   // Edge (ISA, MSI); 0 on success; unmasks the line
+int irq_register_level(uint8_t line, irq_handler_t handler, void* ctx); // Level, active low (PCI INTx)
+void irq_unregister(uint8_t line, irq_handler_t handler, void* ctx); // Masks the line when it was the last
+void irq_dispatch(uint64_t line);  // From irq_common
+
+// Per-line statistics. Counts are always kept; handler timing (rdtsc
+// around the handlers and the EOI) only while sampling is on.
+typedef struct {
+    uint32_t handlers;      // Registered on the line
+    uint64_t count;         // Dispatched, spurious ones not included
+    uint64_t unhandled;     // No handler claimed it
+    uint64_t spurious;
+    uint64_t samples;       // Timed dispatches
+    uint64_t cycles_min;
+    uint64_t cycles_max;
+    uint64_t cycles_total;
+    uint64_t storms;        // Seconds that went over IRQ_STORM_RATE
+    int storming;           // This second or the last one did
+} irq_stats_t;
+
+void irq_set_sampling(int on);
+int irq_get_sampling();
+int irq_get_stats(uint32_t line, irq_stats_t* stats);  // -1 past the last line
+void irq_reset_stats();
+
+#endif
@@ -5,5 +5,6 @@
 
 void isr_install();
 void irq_handler();
+void isr_page_fault(uint64_t error, uint64_t rip);
 
 #endif
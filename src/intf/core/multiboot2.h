@@ -0,0 +1,54 @@
+#ifndef MULTIBOOT2_H
+#define MULTIBOOT2_H
+
+#include <stdint.h>
+
+// Boot information handed over by a multiboot2 loader in ebx
+
+#define MULTIBOOT2_TAG_END           0
+#define MULTIBOOT2_TAG_BASIC_MEMINFO 4
+#define MULTIBOOT2_TAG_MMAP          6
+#define MULTIBOOT2_TAG_ACPI_OLD      14     // Copy of the ACPI 1.0 RSDP
+#define MULTIBOOT2_TAG_ACPI_NEW      15     // Copy of the ACPI 2.0+ RSDP
+
+// Memory map entry types
+#define MULTIBOOT2_MEMORY_AVAILABLE        1
+#define MULTIBOOT2_MEMORY_RESERVED         2
+#define MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT2_MEMORY_NVS              4
+#define MULTIBOOT2_MEMORY_BADRAM           5
+
+struct multiboot2_info {
+    uint32_t total_size;
+    uint32_t reserved;
+} __attribute__((packed));
+
+// Tags follow the info header, each padded to 8 bytes
+struct multiboot2_tag {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed));
+
+struct multiboot2_tag_basic_meminfo {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mem_lower;    // KB below 1 MB
+    uint32_t mem_upper;    // KB above 1 MB, up to the first hole
+} __attribute__((packed));
+
+struct multiboot2_mmap_entry {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t zero;
+} __attribute__((packed));
+
+struct multiboot2_tag_mmap {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    // struct multiboot2_mmap_entry entries[], entry_size bytes apart
+} __attribute__((packed));
+
+#endif
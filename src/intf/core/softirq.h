@@ -0,0 +1,31 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+
+// Deferred interrupt work. A hard IRQ handler acknowledges its device and
+// raises a softirq; the work then runs with interrupts enabled, on the way
+// out of the interrupt or from the idle loop, never nested in itself.
+#define SOFTIRQ_MAX      16
+#define SOFTIRQ_RESTARTS 4      // Passes per IRQ exit; what is raised after that waits for idle
+
+typedef void (*softirq_fn_t)(void* ctx);
+
+typedef struct {
+    const char* name;
+    uint64_t raised;        // softirq_raise calls
+    uint64_t runs;          // Times fn ran (raises while pending coalesce)
+    uint64_t cycles;        // Total TSC cycles spent in fn
+    uint64_t max_cycles;
+} softirq_info_t;
+
+int softirq_register(const char* name, softirq_fn_t fn, void* ctx);   // Id, -1 if out of slots
+void softirq_raise(int id);     // Any context
+void softirq_run();             // Run what is pending; from irq_dispatch and cpu_idle
+int softirq_pending();
+void softirq_disable();         // Nests; raised work waits, interrupts are never turned on
+void softirq_enable();          // What is pending runs at the next IRQ exit or idle
+int softirq_get_info(int id, softirq_info_t* info);     // -1 past the last id
+uint64_t softirq_get_deferred();    // IRQ exits that left work for the idle loop
+
+#endif
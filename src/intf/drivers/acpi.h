@@ -0,0 +1,28 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// Common header of every ACPI system description table
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;        // Whole table, header included
+    uint8_t revision;
+    uint8_t checksum;       // All bytes of the table sum to 0
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// Finds the RSDP, in the multiboot2 tags or by scanning the BIOS areas.
+// Runs before paging_init, while the boot tables still map low memory;
+// the multiboot info is not kept past memory_init.
+int acpi_init(uint64_t multiboot_info);     // 0 if ACPI is there
+
+// Table by signature ("APIC" for the MADT), mapped into the direct map
+// and checksummed. Needs paging_init. 0 if absent.
+struct acpi_sdt_header* acpi_find_table(const char* signature);
+
+#endif
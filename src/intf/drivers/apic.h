@@ -0,0 +1,20 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+// Local APIC and I/O APIC, found through the ACPI MADT. apic_init takes
+// over from the 8259 (which stays masked) and moves every registered IRQ
+// line to the I/O APIC; without a MADT or an APIC the PIC stays in charge.
+// Lines 0-15 are ISA IRQs, routed through the MADT's source overrides;
+// higher lines are GSIs. Either way line n arrives on vector 0x20 + n.
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+int apic_init();                    // 0 if the APIC took over; needs acpi_init and paging_init
+int apic_active();
+int apic_x2apic();                  // Registers accessed through MSRs instead of MMIO
+uint32_t apic_id();                 // Local APIC ID of this CPU
+void apic_eoi();
+void apic_send_self(uint8_t vector);    // Fixed IPI to this CPU
+
+#endif
@@ -0,0 +1,30 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+// Region allocator for short-lived work: objects are bump-allocated from
+// large heap chunks and released all at once by karena_reset/karena_destroy.
+#define KARENA_DEFAULT_CHUNK (16 * 1024)
+
+typedef struct karena_chunk karena_chunk_t;
+
+typedef struct {
+    karena_chunk_t* head;       // Chunk currently being carved, older ones behind it
+    karena_chunk_t* first;      // Chunk holding this struct, kept across resets
+    void* objects;              // Unpooled mode: every live object, linked
+    uint64_t chunk_size;        // 0 = unpooled, one kmalloc per object
+    uint64_t allocs;            // Objects handed out since create
+    uint64_t bytes;             // Payload bytes handed out since create
+    uint64_t heap_calls;        // kmalloc + kfree calls made on our behalf
+} karena_t;
+
+karena_t* karena_create(uint64_t chunk_size);   // 0 picks KARENA_DEFAULT_CHUNK
+karena_t* karena_create_unpooled();             // Per-object kmalloc, for debugging and baselines
+void* karena_alloc(karena_t* arena, uint64_t size);
+char* karena_strndup(karena_t* arena, const char* str, uint64_t len);
+void karena_reset(karena_t* arena);             // Free every object, keep the first chunk
+void karena_destroy(karena_t* arena);
+
+#endif
@@ -81,6 +81,7 @@ typedef struct {
 // Core functions
 int fat32_init(uint32_t partition_lba);
 int fat32_read_file(const char* path, uint8_t* buffer, uint32_t max_size);
+int fat32_read_file_at(const char* path, uint32_t offset, uint8_t* buffer, uint32_t max_size);
 int fat32_list_directory(fat32_file_info_t* files, uint32_t max_files);
 int fat32_file_exists(const char* path);
 uint32_t fat32_get_file_size(const char* path);
@@ -4,14 +4,75 @@
 
 #include <stdint.h>
 
+// Small requests (up to 2 KB) are served from per-size-class slabs
+#define HEAP_SLAB_CLASSES 8
+
+// The heap owns a fixed virtual window; heap_init maps the start of it and
+// kmalloc maps fresh frames behind it on demand, up to HEAP_VIRT_SIZE
+#define HEAP_VIRT_BASE 0xFFFFC00000000000ULL
+#define HEAP_VIRT_SIZE (256ULL * 1024 * 1024)
+
+// Requests this big skip the heap and take whole contiguous frames, which
+// are used through the direct map and returned to the frame allocator by kfree
+#define HEAP_LARGE_THRESHOLD (32 * 1024)
+
+typedef struct {
+    uint64_t object_size;   // Largest request served by this class
+    uint64_t hits;          // Allocations served from an existing slab
+    uint64_t misses;        // Allocations that had to create a new slab
+    uint64_t live;          // Objects currently allocated
+    uint64_t slabs;         // Slabs currently held by the class
+} heap_slab_stats_t;
+
 void heap_init(uint64_t start, uint64_t size);
 void* kmalloc(uint64_t size);
 void kfree(void* ptr);
+void* kcalloc(uint64_t count, uint64_t size);          // Zeroed, 0 if count * size overflows
+void* krealloc(void* ptr, uint64_t size);              // Resizes in place when the next block is free
+void* kmalloc_aligned(uint64_t size, uint64_t align);  // align must be a power of two
+void* kmalloc_pages(uint64_t pages);                   // Page aligned and physically contiguous
+void* kmalloc_pages_zone(uint64_t pages, int zone);    // Same, below the zone's limit (ZONE_DMA32 for 32-bit DMA)
+uint64_t kvirt_to_phys(const void* ptr);               // Physical address for DMA, 0 if unmapped
+void heap_trim();                       // Return free pages at the top of the heap, call when idle
 
 // New functions for memory info
 uint64_t heap_get_used();
 uint64_t heap_get_free();
 uint64_t heap_get_total();
 uint64_t heap_get_allocations();
+int heap_get_slab_stats(int class_idx, heap_slab_stats_t* stats);
+uint64_t heap_get_largest_free();       // Biggest single request that can succeed
+uint64_t heap_get_fragmentation();      // Percent of free memory outside the largest block
+const char* heap_get_backend();         // Block allocator selected at build time
+uint64_t heap_get_limit();              // Most the heap may grow to
+uint64_t heap_get_grows();              // Times kmalloc had to map more pages
+uint64_t heap_get_trimmed_pages();      // Pages handed back to the frame allocator
+uint64_t heap_get_large_objects();      // Live kmalloc_pages allocations
+uint64_t heap_get_large_pages();        // Frames they hold
+uint64_t heap_get_calls();              // Allocator entry points called since heap_init
+uint64_t heap_get_realloc_in_place();   // krealloc calls that kept the pointer
+uint64_t heap_get_realloc_moved();      // krealloc calls that had to copy
+
+// ===== ALLOCATION PROFILER =====
+// Off by default. While on, every live block is recorded with its caller's
+// return address and the subsystem tag that was current when it was made.
+#define HEAP_PROF_HIST_BUCKETS 13   // <=16 B, <=32 B, ... <=32 KB, larger
+#define HEAP_PROF_SORT_BYTES   0
+#define HEAP_PROF_SORT_COUNT   1
+
+typedef struct {
+    void* site;             // Return address of the allocating call, 0 when grouped by tag
+    const char* tag;
+    uint64_t bytes;         // Live bytes requested
+    uint64_t count;         // Live blocks
+} heap_prof_site_t;
+
+int heap_prof_enable(int on);               // -1 if the record table can't be allocated
+int heap_prof_enabled();
+const char* heap_prof_set_tag(const char* tag);     // Returns the previous tag
+int heap_prof_top_sites(heap_prof_site_t* out, int max, int sort);
+int heap_prof_top_tags(heap_prof_site_t* out, int max);
+void heap_prof_histogram(uint64_t* counts, uint64_t* bytes);
+uint64_t heap_prof_dropped();               // Blocks not recorded because the table was full
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+// kmem_cache.h
+#ifndef KMEM_CACHE_H
+#define KMEM_CACHE_H
+
+#include <stdint.h>
+
+// Caches of same-sized objects. Freed objects go back on the cache's free
+// stack instead of the heap, so a steady alloc/free cycle never touches
+// kmalloc. The constructor runs once when an object is first created;
+// objects must be handed back to kmem_cache_free in that constructed state.
+#define KMEM_MAX_CACHES 16
+
+typedef void (*kmem_ctor_t)(void* obj);
+typedef struct kmem_cache kmem_cache_t;
+
+typedef struct {
+    const char* name;
+    uint64_t object_size;
+    uint64_t allocs;        // kmem_cache_alloc calls served
+    uint64_t frees;
+    uint64_t live;          // Objects currently handed out
+    uint64_t free_objects;  // Constructed objects waiting on the free stack
+    uint64_t slabs;         // Backing allocations taken from the heap
+    uint64_t ctor_calls;
+} kmem_cache_stats_t;
+
+kmem_cache_t* kmem_cache_create(const char* name, uint64_t size, uint64_t align, kmem_ctor_t ctor);
+void kmem_cache_destroy(kmem_cache_t* cache);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+int kmem_cache_reserve(kmem_cache_t* cache, uint64_t count);   // Pre-fill, e.g. before use from an IRQ
+int kmem_cache_get_stats(int idx, kmem_cache_stats_t* stats);  // -1 if no cache in that slot
+
+#endif
@@ -5,10 +5,37 @@
 #include <stdint.h>
 
 #define PAGE_SIZE 4096  // 4 KB
+#define MEMORY_ORDERS 19 // Buddy orders 0 (4 KB) to 18 (1 GB)
 
-void memory_init(uint64_t mem_upper); // initialize memory manager
+// Physical zones. A request for one zone falls back to the lower ones,
+// which only lend pages above their watermark.
+#define ZONE_DMA     0  // Below 16 MB, ISA DMA
+#define ZONE_DMA32   1  // Below 4 GB, 32-bit bus masters (RTL8139, ATA bus-master DMA)
+#define ZONE_NORMAL  2  // Everything else; alloc_frame and friends start here
+#define MEMORY_ZONES 3
+
+typedef struct {
+    const char* name;
+    uint64_t present_pages;     // Available RAM in the zone
+    uint64_t free_pages;
+    uint64_t watermark;         // Free pages reserved for this zone's own requests
+    uint64_t fallbacks;         // Allocations it served for a higher zone
+} memory_zone_stats_t;
+
+// Frames come from the available entries of the multiboot2 memory map,
+// minus the low 3 MB and the kernel image (physical addresses)
+void memory_init(uint64_t multiboot_info, uint64_t kernel_start, uint64_t kernel_end);
 void* alloc_frame();
+void* alloc_frames(uint64_t count, uint64_t align); // Physically contiguous, align in bytes (0 = page)
+void* alloc_frames_zone(uint64_t count, uint64_t align, int zone);
+void* alloc_frame_order(int order);     // 2^order pages, aligned to their size
 void free_frame(void* frame);
+void free_frames(void* frame, uint64_t count);
+void free_frame_order(void* frame, int order);
 uint64_t get_total_memory();
+uint64_t get_free_memory();
+uint64_t get_free_blocks(int order);
+int memory_get_zone_stats(int zone, memory_zone_stats_t* stats); // 0 on success
+int memory_get_region(int index, uint64_t* base, uint64_t* end); // Available RAM, byte range; -1 past the last
 
 #endif
@@ -7,11 +7,73 @@
 #define PAGE_PRESENT   0x1
 #define PAGE_RW        0x2
 #define PAGE_USER      0x4
+#define PAGE_PWT       0x8
+#define PAGE_PCD       0x10            // Uncached, for device registers
 #define PAGE_SIZE_2MB  0x80
+#define PAGE_HUGE      PAGE_SIZE_2MB   // PS bit: 2 MB page in a PD entry, 1 GB in a PDPT entry
+#define PAGE_GLOBAL    0x100           // Survives CR3 loads; set on every mapping when CR4.PGE is available
 
 #define PAGE_SIZE 4096
 
+// Address space layout. The kernel is linked in the top 2 GB (the
+// -mcmodel=kernel range) and all available RAM is mapped once more,
+// linearly, at DIRECT_MAP_BASE. Nothing is identity mapped after boot.
+#define KERNEL_VMA       0xFFFFFFFF80000000ULL
+#define DIRECT_MAP_BASE  0xFFFF800000000000ULL
+#define DIRECT_MAP_SIZE  (64ULL << 30)     // Physical memory above this is not used
+
 void paging_init(uint64_t phys_base, uint64_t phys_end, uint64_t heap_start, uint64_t heap_size);
-void map_page(uint64_t virt, uint64_t phys, uint64_t flags);
+int map_page(uint64_t virt, uint64_t phys, uint64_t flags);  // 0 on success, -1 if out of page tables
+uint64_t unmap_page(uint64_t virt);                           // Returns the frame that was mapped, 0 if none; frees emptied tables
+int map_range(uint64_t virt, uint64_t phys, uint64_t len, uint64_t flags); // Largest pages alignment allows
+void unmap_range(uint64_t virt, uint64_t len);                // Huge pages only go if fully covered; frees emptied tables
+uint64_t paging_translate(uint64_t virt);                     // Physical address of virt, 0 if unmapped
+void* paging_map_phys(uint64_t phys, uint64_t len, uint64_t flags); // Direct map address, 0 if out of tables
+
+// Any RAM frame is reachable at a fixed offset, no mapping call needed
+static inline void* phys_to_virt(uint64_t phys) {
+    return (void*)(phys + DIRECT_MAP_BASE);
+}
+
+// Kernel image and direct map addresses convert by subtraction; anything
+// else (heap, vmalloc-style windows) takes a page walk
+static inline uint64_t virt_to_phys(const void* ptr) {
+    uint64_t virt = (uint64_t)ptr;
+    if (virt >= KERNEL_VMA) return virt - KERNEL_VMA;
+    if (virt >= DIRECT_MAP_BASE && virt < DIRECT_MAP_BASE + DIRECT_MAP_SIZE) {
+        return virt - DIRECT_MAP_BASE;
+    }
+    return paging_translate(virt);
+}
+
+// Page tables are handed out pre-zeroed when the idle loop got there first
+uint32_t paging_prezero_tables(uint32_t max);                 // Zero up to max tables ahead, returns how many
+void paging_get_zero_stats(uint64_t* pooled, uint64_t* hits, uint64_t* misses);
+
+typedef struct {
+    uint64_t tables;        // Page tables in use, PML4 included
+    uint64_t tables_freed;  // Tables that emptied and went back, since boot
+    uint64_t pages_4kb;     // Leaf mappings by size
+    uint64_t pages_2mb;
+    uint64_t pages_1gb;
+    uint64_t invlpg;        // Single-page TLB flushes
+    uint64_t full_flushes;  // Whole-TLB flushes (global entries too) by large unmaps
+    int global_pages;       // CR4.PGE currently on
+    int pcid;               // CR4.PCIDE on, CR3 loads are tagged
+    int invpcid;            // invpcid used for full and per-PCID flushes
+} paging_stats_t;
+
+void paging_get_stats(paging_stats_t* stats);
+
+// Address spaces. A space is the physical address of a PML4; clones share
+// every lower table with the kernel's, so they differ only in their TLB
+// tag. PCID 0 belongs to the kernel space. Without PCID support the tag
+// and keep are ignored and every switch flushes non-global entries.
+uint64_t paging_kernel_space();
+uint64_t paging_clone_space();                                // 0 if out of frames
+void paging_switch(uint64_t space, uint16_t pcid, int keep);  // keep: leave pcid's cached entries valid
+void paging_release_space(uint64_t space, uint16_t pcid);     // Drop pcid's entries and free the PML4; not while loaded
+void paging_flush_tlb();                                      // Everything, global entries included
+int paging_set_global(int on);                                // Toggle CR4.PGE (flushes), returns the previous state
 
 #endif
@@ -7,5 +7,21 @@ void pci_config_write_dword(uint8_t bus, uint8_t slot, uint8_t func, uint8_t off
 int pci_find_device(uint16_t vendor_id, uint16_t device_id, uint8_t *bus, uint8_t *slot, uint8_t *func);
 uint8_t pci_config_read_byte(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
 void pci_config_write_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value);
+uint16_t pci_config_read_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+
+// Capability IDs
+#define PCI_CAP_MSI  0x05
+#define PCI_CAP_MSIX 0x11
+
+// Config space offset of the capability, 0 if the device lacks it
+uint8_t pci_find_capability(uint8_t bus, uint8_t slot, uint8_t func, uint8_t cap_id);
+
+// Message signalled interrupts, one IRQ line per queue. Fills lines[] with
+// up to count dedicated lines to pass to irq_register and returns how many
+// the device got (MSI-X first, then MSI), or -1 when it has neither or no
+// APIC is running; fall back to the INTx line then.
+#define PCI_MSI_DEVICES 8
+int pci_enable_msi(uint8_t bus, uint8_t slot, uint8_t func, uint8_t *lines, uint32_t count);
+void pci_disable_msi(uint8_t bus, uint8_t slot, uint8_t func); // Back to INTx, lines freed
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+#include "core/irq.h"
+
+// Legacy 8259 pair, remapped to vectors 0x20-0x2F. Lines 8-15 sit on the
+// slave, which is cascaded into master line 2.
+#define PIC_LINES 16
+
+void pic_remap();               // Every line starts masked
+void pic_unmask(uint8_t line);
+void pic_mask(uint8_t line);
+void pic_eoi(uint8_t line);     // Slave lines need an EOI on both chips
+int pic_spurious(uint8_t line); // 1 if line 7/15 fired with nothing in service
+void pic_disable();             // Mask everything, for when the APIC takes over
+
+extern const irq_chip_t pic_chip;
+
+#endif
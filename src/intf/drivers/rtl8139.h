@@ -3,6 +3,6 @@
 #include <stdint.h>
 
 int rtl8139_probe_init(void); // returns 0 on success
-void rtl8139_handle_irq(void); // call from your IRQ stub or register an IDT entry
+int rtl8139_handle_irq(void *ctx); // irq_handler_t, registered by rtl8139_probe_init
 
 #endif
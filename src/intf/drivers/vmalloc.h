@@ -0,0 +1,34 @@
+// vmalloc.h
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include <stdint.h>
+
+// Virtually contiguous buffers stitched together from scattered frames,
+// for sizes the heap cannot find in one piece. Each allocation is its own
+// vmregion: page granular, zeroed, and followed by an unmapped guard page.
+#define VMALLOC_MAX 32
+
+typedef struct {
+    void* addr;
+    uint64_t size;          // Bytes requested
+    uint64_t pages;         // Frames mapped behind it
+    void* caller;           // Return address of the vmalloc call
+} vmalloc_info_t;
+
+typedef struct {
+    uint64_t live;          // Allocations not freed yet
+    uint64_t bytes;         // Bytes requested by them
+    uint64_t pages;         // Frames mapped for them
+    uint64_t peak_pages;
+    uint64_t allocs;        // Since boot
+    uint64_t frees;
+    uint64_t failures;
+} vmalloc_stats_t;
+
+void* vmalloc(uint64_t size);       // 0 if out of frames, slots or address space
+void vfree(void* addr);             // Unknown pointers are ignored
+int vmalloc_get_info(int index, vmalloc_info_t* info); // index-th live allocation, -1 past the last
+void vmalloc_get_stats(vmalloc_stats_t* stats);
+
+#endif
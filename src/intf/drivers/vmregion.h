@@ -0,0 +1,48 @@
+// vmregion.h
+#ifndef VMREGION_H
+#define VMREGION_H
+
+#include <stdint.h>
+
+// Demand-paged kernel memory. A region reserves a virtual range up front;
+// a page only gets a frame when it is first touched, from the page fault
+// handler, and the region's pager fills it before it is mapped.
+#define VM_REGION_BASE 0xFFFFA00000000000ULL
+#define VM_REGION_SIZE (64ULL << 30)    // Window all regions are carved from
+#define VM_REGION_MAX  64
+
+typedef struct vm_region vm_region_t;
+
+// Fill the page at byte offset in the region. page is the new frame's
+// direct map address. Runs inside the fault handler, interrupts off.
+// Returns 0 on success; anything else makes the access a fatal fault.
+typedef int (*vm_pager_t)(vm_region_t* region, uint64_t offset, void* page);
+
+struct vm_region {
+    const char* name;
+    uint64_t base;          // Page aligned, 0 = slot unused
+    uint64_t size;          // Bytes, page multiple
+    uint64_t flags;         // Page flags for faulted-in pages
+    vm_pager_t pager;       // 0 = zero fill
+    void* pager_data;
+    uint64_t resident;      // Pages currently backed by frames
+    uint64_t faults;        // Pages filled since the region was reserved
+};
+
+typedef struct {
+    uint64_t regions;
+    uint64_t reserved_pages;
+    uint64_t resident_pages;
+    uint64_t faults;
+} vm_region_stats_t;
+
+vm_region_t* vm_region_reserve(const char* name, uint64_t size, uint64_t flags); // 0 if out of slots or space
+void vm_region_attach(vm_region_t* region, vm_pager_t pager, void* data);       // pager 0 = zero fill
+int vm_region_attach_file(vm_region_t* region, const char* path);                // FAT32 file, zero past its end
+int vm_region_populate(vm_region_t* region);    // Back every page now instead of on first touch
+void vm_region_discard(vm_region_t* region);    // Free every resident page; touching it refills it
+void vm_region_release(vm_region_t* region);    // Discard and give the slot back
+int vm_region_fault(uint64_t addr, uint64_t error); // From the #PF handler, 0 if the page is now mapped
+void vm_region_get_stats(vm_region_stats_t* stats);
+
+#endif
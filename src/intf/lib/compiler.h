@@ -1,10 +1,15 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <stdint.h>
+
 int compile_and_run(char* source);
 
 int compile_file(const char* filename);
 
 void cmd_compile(const char* args);
 
+// Times lexing + code generation with per-object kmalloc vs an arena
+void compiler_bench(uint32_t iterations);
+
 #endif
\ No newline at end of file
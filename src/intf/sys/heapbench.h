@@ -0,0 +1,11 @@
+#ifndef HEAPBENCH_H
+#define HEAPBENCH_H
+
+#include <stdint.h>
+
+// Runs the same mixed alloc/free workload on the old first-fit allocator,
+// on the block backend directly and on kmalloc/kfree, then prints cycle
+// counts for each; the speedup compares the first two
+void heapbench_run(uint32_t ops);
+
+#endif
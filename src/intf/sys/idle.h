@@ -0,0 +1,9 @@
+// idle.h
+#ifndef IDLE_H
+#define IDLE_H
+
+// Called by every "wait for the next interrupt" loop. Does a small slice
+// of deferred background work, then halts until an interrupt arrives.
+void cpu_idle(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef IRQBENCH_H
+#define IRQBENCH_H
+
+#include <stdint.h>
+
+// Times interrupt entry and round trip through irq_dispatch on the active
+// controller (software int, plus a self-IPI when the APIC is up) and the
+// EOI cost of the 8259 and the local APIC, in TSC cycles
+void irqbench_run(uint32_t rounds);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef TLBBENCH_H
+#define TLBBENCH_H
+
+#include <stdint.h>
+
+// Maps the same physical buffer with 4 KB and then 2 MB pages, touches
+// every page in a scattered order and prints page tables used and cycles
+// per access for both
+void tlbbench_run(uint32_t mb);
+
+// Switches CR3 between the kernel space and a clone, touching a small
+// working set each time, with a full flush per switch, with global pages
+// and with PCID-tagged switches, and prints cycles per switch for each
+void tlbbench_switch_run(uint32_t rounds);
+
+#endif